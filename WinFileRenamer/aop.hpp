@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <utility>
 #include <thread>
 #include <mutex>
@@ -16,9 +17,6 @@ namespace aop {
 template <typename _Tp>
 class LockBox {
 private:
-	class LockProxy;
-	friend class LockProxy;
-
 	std::mutex mtx_;
 	_Tp obj_;
 
@@ -81,6 +79,67 @@ public:
 template <typename _Tp>
 using LockGuard = typename LockBox<_Tp>::LockProxy;
 
+// Copy-on-write value shared with readers as immutable, reference-counted versions.
+//
+// pin() hands out the current version in O(1), however large the value, and that version
+// never changes afterwards. edit() changes the value in place until the current version
+// has been pinned, and then a copy that becomes the next version, so a run of edits
+// copies at most once; replace() starts a new version without copying. version() counts
+// the changes.
+template <typename _Tp>
+class CowBox {
+private:
+	std::mutex mtx_;
+	std::shared_ptr<_Tp> cur_;
+	bool pinned_ = false;
+	uint64_t version_ = 0;
+
+public:
+	CowBox() : cur_(std::make_shared<_Tp>()) {}
+
+	CowBox(const CowBox&) = delete;
+	CowBox& operator=(const CowBox&) = delete;
+
+	[[nodiscard]] std::shared_ptr<const _Tp> pin() {
+		std::lock_guard<std::mutex> lck(mtx_);
+		pinned_ = true;
+		return cur_;
+	}
+
+	// Calls fn(value) on the current version, which no edit can change meanwhile, without
+	// pinning it.
+	template <typename Fn>
+	decltype(auto) read(Fn&& fn) {
+		std::lock_guard<std::mutex> lck(mtx_);
+		return fn(static_cast<const _Tp&>(*cur_));
+	}
+
+	// Calls fn(value) on a version nobody else holds and returns its result.
+	template <typename Fn>
+	decltype(auto) edit(Fn&& fn) {
+		std::lock_guard<std::mutex> lck(mtx_);
+		if (pinned_) {
+			cur_ = std::make_shared<_Tp>(*cur_);
+			pinned_ = false;
+		}
+		++version_;
+		return fn(*cur_);
+	}
+
+	void replace(_Tp value) {
+		auto next = std::make_shared<_Tp>(std::move(value));
+		std::lock_guard<std::mutex> lck(mtx_);
+		cur_ = std::move(next);
+		pinned_ = false;
+		++version_;
+	}
+
+	uint64_t version() {
+		std::lock_guard<std::mutex> lck(mtx_);
+		return version_;
+	}
+};
+
 }
 
 #endif // !_AOP_HPP
\ No newline at end of file
@@ -0,0 +1,73 @@
+﻿#ifndef _BOUNDED_QUEUE_HPP
+#define _BOUNDED_QUEUE_HPP
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace aop {
+
+// Blocking FIFO of at most capacity items, connecting the stages of a pipeline: a fast
+// producer waits for its consumer instead of buffering without limit.
+//
+// close() ends the stream from either side. Afterwards push() refuses new items, and
+// pop() drains what is queued and then reports the end; a producer blocked on a full
+// queue whose consumer has given up is released the same way.
+template <typename _Tp>
+class BoundedQueue {
+private:
+	std::mutex mtx_;
+	std::condition_variable not_full_;
+	std::condition_variable not_empty_;
+	std::deque<_Tp> items_;
+	size_t capacity_;
+	bool closed_ = false;
+
+public:
+	explicit BoundedQueue(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// Blocks while the queue is full. Returns false, leaving item alone, once closed.
+	bool push(_Tp&& item) {
+		{
+			std::unique_lock<std::mutex> lck(mtx_);
+			not_full_.wait(lck, [this] { return closed_ || items_.size() < capacity_; });
+			if (closed_) return false;
+			items_.emplace_back(std::move(item));
+		}
+		not_empty_.notify_one();
+		return true;
+	}
+
+	// Blocks while the queue is empty and open. Returns false at the end of the stream.
+	bool pop(_Tp& out) {
+		{
+			std::unique_lock<std::mutex> lck(mtx_);
+			not_empty_.wait(lck, [this] { return closed_ || !items_.empty(); });
+			if (items_.empty()) return false;
+			out = std::move(items_.front());
+			items_.pop_front();
+		}
+		not_full_.notify_one();
+		return true;
+	}
+
+	void close() {
+		{
+			std::lock_guard<std::mutex> lck(mtx_);
+			closed_ = true;
+		}
+		not_full_.notify_all();
+		not_empty_.notify_all();
+	}
+};
+
+}
+
+#endif // !_BOUNDED_QUEUE_HPP
@@ -6,13 +6,17 @@
 #include <vector>
 #include <queue>
 #include <cstdint>
+#include <cstring>
 #include <utility>
 #include <functional>
 #include <array>
 #include <memory>
+#include <optional>
 #include <stack>
 #include <string>
+#include <string_view>
 #include <exception>
+#include <stdexcept>
 #include <sstream>
 #include <filesystem>
 
@@ -21,408 +25,419 @@
 
 #include <iostream>
 
+#include "calc_format.hpp"
+
 namespace calc {
 
+	// Expression token / value, stored by value in contiguous vectors.
+	//
+	// type_ tells what the element is ('S', 'Z', 'F', 'X', '(', ')', '#').
+	// kind_ is the operator char for '#' and the variable char for 'X'.
+	// The payload holds the integer (value, minimum length or operator priority)
+	// or the string; strings of up to SSO_CAP characters are stored inline.
 	class Element {
-	protected:
-		int64_t data;
 	public:
-		Element() { data = 0; }
-		virtual ~Element() {}
-		constexpr virtual int64_t get_type() = 0;
+		static constexpr size_t SSO_CAP = 24 / sizeof(wchar_t);
 
-		virtual std::unique_ptr<Element> clone() = 0;
+	protected:
+		uint8_t type_ = 0;
+		uint8_t kind_ = 0;
+		uint8_t heap_ = 0;
+		uint32_t len_ = 0;
+
+		union Payload {
+			int64_t data;
+			wchar_t sso[SSO_CAP];
+			wchar_t* ptr;
+		} u_;
+
+		Element(int64_t type, int64_t kind, int64_t data) noexcept {
+			type_ = static_cast<uint8_t>(type);
+			kind_ = static_cast<uint8_t>(kind);
+			u_.data = data;
+		}
+
+		Element(const wchar_t* s, size_t n) : u_{} {
+			type_ = 'S';
+			assign_str(s, n);
+		}
+
+		// Makes room for a string of n characters and returns where to write it.
+		wchar_t* alloc_str(size_t n) {
+			wchar_t* dst = u_.sso;
+			if (n > SSO_CAP) {
+				dst = new wchar_t[n];
+				u_.ptr = dst;
+				heap_ = 1;
+			}
+			len_ = static_cast<uint32_t>(n);
+			return dst;
+		}
 
-		virtual const std::wstring get_str() const {
-			throw std::runtime_error("Cant transform this class into wstring !");
-			return std::wstring{};
+		void assign_str(const wchar_t* s, size_t n) {
+			wchar_t* dst = alloc_str(n);
+			if (n) std::memcpy(dst, s, n * sizeof(wchar_t));
 		}
-	};
 
-	class Str final : public Element {
-	private:
-		friend class Int64;
-		friend class Int64Opt;
-		friend class Add_Int64Opt;
-		std::wstring str;
-	public:
-		Str() = default;
-		Str(int64_t x) {
-			std::wstringstream ss;
-			ss << x;
-			ss >> str;
+		void release() noexcept {
+			if (heap_) delete[] u_.ptr;
+			heap_ = 0;
+			len_ = 0;
 		}
-		Str(const std::wstring& cpp_string) : str(cpp_string) {}
-		Str(std::wstring&& cpp_string) : str(std::move(cpp_string)) {}
-		Str(const Str& other) : str(other.str) {}
-		Str(Str&& other) noexcept { str = std::move(other.str); }
 
-		Str& operator=(const std::wstring& cpp_string) {
-			str = cpp_string;
-			return *this;
+		void copy_from(const Element& other) {
+			type_ = other.type_;
+			kind_ = other.kind_;
+			if (other.heap_) {
+				assign_str(other.u_.ptr, other.len_);
+			} else {
+				std::memcpy(&u_, &other.u_, sizeof(u_));
+				len_ = other.len_;
+			}
 		}
-		Str& operator=(std::wstring&& cpp_string) {
-			str = std::move(cpp_string);
-			return *this;
+
+		void move_from(Element& other) noexcept {
+			type_ = other.type_;
+			kind_ = other.kind_;
+			heap_ = other.heap_;
+			len_ = other.len_;
+			std::memcpy(&u_, &other.u_, sizeof(u_));
+			other.heap_ = 0;
+			other.len_ = 0;
 		}
-		Str& operator=(const Str& other) {
-			str = other.str;
+
+	public:
+		Element() noexcept { u_.data = 0; }
+		Element(const Element& other) { copy_from(other); }
+		Element(Element&& other) noexcept { move_from(other); }
+
+		Element& operator=(const Element& other) {
+			if (this != &other) {
+				release();
+				copy_from(other);
+			}
 			return *this;
 		}
-		Str& operator=(Str&& other) noexcept {
-			str = std::move(other.str);
+
+		Element& operator=(Element&& other) noexcept {
+			if (this != &other) {
+				release();
+				move_from(other);
+			}
 			return *this;
 		}
 
-		virtual ~Str() {}
-		constexpr virtual int64_t get_type() { return 'S'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Str>(*this); }
+		~Element() { release(); }
 
-		virtual const std::wstring get_str() const override { return str; }
+		constexpr int64_t get_type() const noexcept { return type_; }
 
-		friend std::wostream& operator<<(std::wostream& out, const Str& s) {
-			out << s.str;
-			return out;
+		// 'Z': value, 'F': minimum length, '#': priority
+		int64_t get_val() const noexcept { return u_.data; }
+		int64_t get_min_length() const noexcept { return u_.data; }
+		int64_t get_priority() const noexcept { return u_.data; }
+
+		constexpr int64_t get_var_type() const noexcept { return kind_; }
+		constexpr int64_t get_opt_type() const noexcept { return kind_; }
+
+		std::wstring_view str_view() const noexcept {
+			return std::wstring_view(heap_ ? u_.ptr : u_.sso, len_);
 		}
 
+		const std::wstring get_str() const {
+			if (type_ == 'S') return std::wstring(str_view());
+			if (type_ == 'Z') return int_to_wstring(u_.data);
+			throw std::runtime_error("Cant transform this class into wstring !");
+			return std::wstring{};
+		}
+	};
+
+	// The classes below only construct an Element of the given type; they add no data,
+	// so they can be pushed into a std::vector<Element> directly.
+
+	class Str final : public Element {
+	public:
+		Str() : Element(L"", 0) {}
+		// x padded to min_len digits, as by Mul_Int64Opt.
+		Str(int64_t x, int64_t min_len = 0) : Element('S', 0, 0) {
+			format_int(alloc_str(formatted_length(x, min_len)), x, min_len);
+		}
+		Str(std::wstring_view s) : Element(s.data(), s.size()) {}
+		// a followed by b, built in place.
+		Str(std::wstring_view a, std::wstring_view b) : Element('S', 0, 0) {
+			wchar_t* dst = alloc_str(a.size() + b.size());
+			if (!a.empty()) std::memcpy(dst, a.data(), a.size() * sizeof(wchar_t));
+			if (!b.empty()) std::memcpy(dst + a.size(), b.data(), b.size() * sizeof(wchar_t));
+		}
+		Str(const std::wstring& s) : Element(s.data(), s.size()) {}
+		Str(const wchar_t* s) : Element(s, std::char_traits<wchar_t>::length(s)) {}
 	};
 
 	class Int64_Format final : public Element {
 	public:
-		Int64_Format() = default;
-		Int64_Format(int64_t minimumLength) { data = minimumLength; }
-		virtual ~Int64_Format() {}
-		constexpr int64_t get_type() override { return 'F'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Int64_Format>(*this); }
-		int64_t get_min_length() const { return data; }
+		Int64_Format(int64_t minimumLength = 0) : Element('F', 0, minimumLength) {}
 	};
 
 	class Lbracket final : public Element {
 	public:
-		Lbracket() = default;
-		virtual ~Lbracket() {}
-		constexpr virtual int64_t get_type() override { return '('; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Lbracket>(*this); }
+		Lbracket() : Element('(', 0, 0) {}
 	};
 
 	class Rbracket final : public Element {
 	public:
-		Rbracket() = default;
-		virtual ~Rbracket() {}
-		constexpr virtual int64_t get_type() override { return ')'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Rbracket>(*this); }
+		Rbracket() : Element(')', 0, 0) {}
 	};
 
 	class Int64 final : public Element {
-	private:
-		friend class Str;
-		friend class Int64Opt;
-		friend class Add_Int64Opt;
-		friend class Sub_Int64Opt;
-		friend class Mul_Int64Opt;
-		friend class Div_Int64Opt;
 	public:
-		Int64() = default;
-		Int64(int64_t i) { data = i; }
-		virtual ~Int64() {}
-		constexpr virtual int64_t get_type() override { return 'Z'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Int64>(*this); }
-
-		int64_t get_val() const { return data; }
-
-		bool operator==(const Int64& other) const { return data == other.data; }
-		bool operator<(const Int64& other) const { return data < other.data; }
-		bool operator<=(const Int64& other) const { return data <= other.data; }
-		bool operator>(const Int64& other) const { return data > other.data; }
-		bool operator>=(const Int64& other) const { return data >= other.data; }
-
-		Int64 operator+(const Int64& other) const { return Int64(data + other.data); }
-		Int64 operator-(const Int64& other) const { return Int64(data - other.data); }
-		Int64 operator*(const Int64& other) const { return Int64(data * other.data); }
-		Int64 operator/(const Int64& other) const { return (other.data == 0) ? Int64(0x7fffffffffffffff) : Int64(data / other.data); }
-
-		friend std::wostream& operator<<(std::wostream& out, const Int64& i) {
-			out << i.data;
-			return out;
-		}
-
-		virtual const std::wstring get_str() const override {
-			std::wstringstream wss;
-			wss << data;
-			return wss.str();
-		}
-
+		Int64(int64_t i = 0) : Element('Z', 0, i) {}
 	};
 
 	class Int64Opt : public Element {
+	protected:
+		Int64Opt(int64_t opt_type, int64_t priority) : Element('#', opt_type, priority) {}
+
 	public:
-		Int64Opt() = default;
-		virtual ~Int64Opt() {}
-		constexpr virtual int64_t get_type() override { return '#'; }
+		// Lower priority value binds tighter.
+		static bool binds_tighter(const Element& a, const Element& b) noexcept {
+			return a.get_priority() < b.get_priority();
+		}
 
-		constexpr virtual int64_t get_opt_type() { return '#'; }
+		static Element do_opt(const Element& opt, const Element& a, const Element& b);
 
-		bool operator==(const Int64Opt& other) const { return data == other.data; }
-		bool operator<(const Int64Opt& other) const { return data < other.data; }
-		bool operator<=(const Int64Opt& other) const { return data <= other.data; }
-		bool operator>(const Int64Opt& other) const { return data > other.data; }
-		bool operator>=(const Int64Opt& other) const { return data >= other.data; }
+		// Result type of "type1 opt type2", or 0 if the operator rejects these operand types.
+		static int64_t result_type(int64_t opt_type, int64_t type1, int64_t type2) noexcept;
 
-		using OptFunc = std::function<std::unique_ptr<Element>(const std::unique_ptr<Element>&,const std::unique_ptr<Element>&)>;
+		static const char* opt_name(int64_t opt_type) noexcept;
 
 	protected:
-		static constexpr uint32_t make_key(int64_t type1, int64_t type2) noexcept {
-			return (static_cast<uint32_t>(type1 & 0xFF) << 8) | static_cast<uint32_t>(type2 & 0xFF);
-		}
+		static Element dispatch(int64_t opt_type, const Element& a, const Element& b);
+	};
 
-		static uint32_t make_key(const std::unique_ptr<Element>& a, const std::unique_ptr<Element>& b) noexcept {
-			return make_key(a->get_type(), b->get_type());
-		}
+	// Integer arithmetic of the operators. It wraps around in two's complement, computed
+	// in uint64_t since signed overflow is undefined; the evaluators and constant folding
+	// all use these, so they agree on every input. Division by zero gives INT64_MAX.
+	constexpr int64_t int64_add(int64_t a, int64_t b) noexcept { return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); }
+	constexpr int64_t int64_sub(int64_t a, int64_t b) noexcept { return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); }
+	constexpr int64_t int64_mul(int64_t a, int64_t b) noexcept { return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b)); }
+	constexpr int64_t int64_div(int64_t a, int64_t b) noexcept {
+		if (b == 0) return 0x7fffffffffffffff;
+		if (b == -1) return int64_sub(0, a);	// INT64_MIN / -1 wraps to INT64_MIN
+		return a / b;
+	}
 
-		template <typename T>
-		static const T* as(const std::unique_ptr<Element>& p) {
-			return static_cast<const T*>(p.get());
-		}
+	// Operator rules. OptRule<Op, L, R>::result is the type of "L Op R" and apply()
+	// computes it; combinations without a specialisation are illegal. The dispatch table
+	// below is generated from these at compile time, so type checking and evaluation
+	// share one rule set and dispatch is an indexed load with no startup cost.
+	template <int64_t Op, int64_t L, int64_t R>
+	struct OptRule {
+		static constexpr int64_t result = 0;
+	};
+
+	// Z + Z -> Z
+	template <> struct OptRule<'+', 'Z', 'Z'> {
+		static constexpr int64_t result = 'Z';
+		static Element apply(const Element& a, const Element& b) { return Int64(int64_add(a.get_val(), b.get_val())); }
+	};
 
-		template <typename L, typename R, typename Fn>
-		static OptFunc bind(Fn&& fn) {
-			return [f = std::forward<Fn>(fn)] (const std::unique_ptr<Element>& a, const std::unique_ptr<Element>& b) -> std::unique_ptr<Element> {
-					return f(as<L>(a), as<R>(b));
-			};
+	// Z + S / S + Z / S + S -> S (string concat)
+	template <> struct OptRule<'+', 'Z', 'S'> {
+		static constexpr int64_t result = 'S';
+		static Element apply(const Element& a, const Element& b) {
+			wchar_t buf[MAX_INT_CHARS];
+			return Str(std::wstring_view(buf, format_int(buf, a.get_val())), b.str_view());
 		}
+	};
 
-		static std::unique_ptr<Element> dispatch_or_throw(
-			const std::unordered_map<uint32_t, OptFunc>& table,
-			const std::unique_ptr<Element>& a,
-			const std::unique_ptr<Element>& b,
-			const char* optName
-		) {
-
-			auto it = table.find(make_key(a, b));
-			if (it == table.end()) {
-				std::stringstream ss;
-				ss << "Illegal operator type \"" << optName << "\" !";
-				throw std::runtime_error(ss.str());
-			}
-			return it->second(a, b);
+	template <> struct OptRule<'+', 'S', 'Z'> {
+		static constexpr int64_t result = 'S';
+		static Element apply(const Element& a, const Element& b) {
+			wchar_t buf[MAX_INT_CHARS];
+			return Str(a.str_view(), std::wstring_view(buf, format_int(buf, b.get_val())));
 		}
+	};
 
-	public:
-		virtual std::unique_ptr<Element> do_opt(std::unique_ptr<Element> ptr1, std::unique_ptr<Element> ptr2) = 0;
+	template <> struct OptRule<'+', 'S', 'S'> {
+		static constexpr int64_t result = 'S';
+		static Element apply(const Element& a, const Element& b) { return Str(a.str_view(), b.str_view()); }
 	};
 
-	class Add_Int64Opt final : public Int64Opt {
-	public:
-		Add_Int64Opt() { data = 4; }
-		virtual ~Add_Int64Opt() {}
-		constexpr virtual int64_t get_opt_type() override { return '+'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Add_Int64Opt>(*this); }
-
-	private:
-		static const std::unordered_map<uint32_t, OptFunc>& table() {
-			static const std::unordered_map<uint32_t, OptFunc> t {
-				// Z + Z -> Z
-				{ make_key('Z', 'Z'), bind<Int64, Int64>([](const Int64* a, const Int64* b) {
-					return std::make_unique<Int64>((*a) + (*b));
-				}) },
-
-				// Z + S / S + Z / S + S -> S (string concat)
-				{ make_key('Z', 'S'), bind<Int64, Str>([](const Int64* a, const Str* b) {
-					return std::make_unique<Str>(a->get_str() + b->get_str());
-				}) },
-				{ make_key('S', 'Z'), bind<Str, Int64>([](const Str* a, const Int64* b) {
-					return std::make_unique<Str>(a->get_str() + b->get_str());
-				}) },
-				{ make_key('S', 'S'), bind<Str, Str>([](const Str* a, const Str* b) {
-					return std::make_unique<Str>(a->get_str() + b->get_str());
-				}) },
-			};
-			return t;
-		}
+	template <> struct OptRule<'-', 'Z', 'Z'> {
+		static constexpr int64_t result = 'Z';
+		static Element apply(const Element& a, const Element& b) { return Int64(int64_sub(a.get_val(), b.get_val())); }
+	};
 
-	public:
-		virtual std::unique_ptr<Element> do_opt(std::unique_ptr<Element> ptr1, std::unique_ptr<Element> ptr2) override {
-			return dispatch_or_throw(table(), ptr1, ptr2, "Add");
-		}
+	// Z * Z -> Z
+	template <> struct OptRule<'*', 'Z', 'Z'> {
+		static constexpr int64_t result = 'Z';
+		static Element apply(const Element& a, const Element& b) { return Int64(int64_mul(a.get_val(), b.get_val())); }
+	};
 
-		static void prewarm_table() {
-			(void)table();
-		}
+	// Z * F / F * Z -> S (number formatting)
+	template <> struct OptRule<'*', 'Z', 'F'> {
+		static constexpr int64_t result = 'S';
+		static Element apply(const Element& a, const Element& b) { return Str(a.get_val(), b.get_min_length()); }
 	};
 
-	class Sub_Int64Opt final : public Int64Opt {
-	public:
-		Sub_Int64Opt() { data = 4; }
-		virtual ~Sub_Int64Opt() {}
-		constexpr virtual int64_t get_opt_type() override { return '-'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Sub_Int64Opt>(*this); }
-
-	private:
-		static const std::unordered_map<uint32_t, OptFunc>& table() {
-			static const std::unordered_map<uint32_t, OptFunc> t{
-				{ make_key('Z', 'Z'), bind<Int64, Int64>([](const Int64* a, const Int64* b) {
-					return std::make_unique<Int64>((*a) - (*b));
-				}) },
-			};
-			return t;
-		}
+	template <> struct OptRule<'*', 'F', 'Z'> {
+		static constexpr int64_t result = 'S';
+		static Element apply(const Element& a, const Element& b) { return Str(b.get_val(), a.get_min_length()); }
+	};
 
-	public:
-		virtual std::unique_ptr<Element> do_opt(std::unique_ptr<Element> ptr1, std::unique_ptr<Element> ptr2) override {
-			return dispatch_or_throw(table(), ptr1, ptr2, "Sub");
-		}
+	template <> struct OptRule<'/', 'Z', 'Z'> {
+		static constexpr int64_t result = 'Z';
+		static Element apply(const Element& a, const Element& b) { return Int64(int64_div(a.get_val(), b.get_val())); }
+	};
 
-		static void prewarm_table() {
-			(void)table();
-		}
+	struct OptEntry {
+		int64_t result;
+		Element (*apply)(const Element&, const Element&);
 	};
 
-	class Mul_Int64Opt final : public Int64Opt {
-	public:
-		Mul_Int64Opt() { data = 3; }
-		virtual ~Mul_Int64Opt() {}
-		constexpr virtual int64_t get_opt_type() override { return '*'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Mul_Int64Opt>(*this); }
-
-	private:
-		static int64_t cnt_num_len(int64_t n) {
-			// handle negative + INT64_MIN safely
-			uint64_t u = 0;
-			if (n < 0) {
-				u = static_cast<uint64_t>(-(n + 1)) + 1ULL;
-			} else {
-				u = static_cast<uint64_t>(n);
-			}
+	// Operators and operand types in table order; the last slot of each catches
+	// everything else and only holds illegal entries.
+	inline constexpr int64_t opt_slots[] = { '+', '-', '*', '/', 0 };
+	inline constexpr int64_t type_slots[] = { 'Z', 'S', 'F', 0 };
+	inline constexpr size_t OPT_SLOTS = std::size(opt_slots);
+	inline constexpr size_t TYPE_SLOTS = std::size(type_slots);
+
+	template <size_t N>
+	constexpr std::array<uint8_t, 256> make_slot_map(const int64_t (&slots)[N]) {
+		std::array<uint8_t, 256> map{};
+		for (auto& m : map) m = static_cast<uint8_t>(N - 1);
+		for (size_t i = 0; i + 1 < N; ++i) map[static_cast<size_t>(slots[i])] = static_cast<uint8_t>(i);
+		return map;
+	}
 
-			if (u == 0) return 1;
-			int64_t cnt = 0;
-			while (u > 0) {
-				u /= 10;
-				++cnt;
-			}
+	inline constexpr auto opt_slot_map = make_slot_map(opt_slots);
+	inline constexpr auto type_slot_map = make_slot_map(type_slots);
 
-			return cnt;
-		}
+	template <size_t I>
+	constexpr OptEntry make_opt_entry() {
+		using Rule = OptRule<opt_slots[I / (TYPE_SLOTS * TYPE_SLOTS)], type_slots[(I / TYPE_SLOTS) % TYPE_SLOTS], type_slots[I % TYPE_SLOTS]>;
+		if constexpr (Rule::result != 0) return { Rule::result, &Rule::apply };
+		else return { 0, nullptr };
+	}
 
-		static std::unique_ptr<Element> format_with_min_len(
-			const Int64* num_ptr,
-			const Int64_Format* fmt_ptr) {
+	template <size_t... I>
+	constexpr std::array<OptEntry, sizeof...(I)> make_opt_table(std::index_sequence<I...>) {
+		return { make_opt_entry<I>()... };
+	}
 
-			std::wstringstream wss;
+	// opt_table[(op * TYPE_SLOTS + left) * TYPE_SLOTS + right]
+	inline constexpr auto opt_table = make_opt_table(std::make_index_sequence<OPT_SLOTS * TYPE_SLOTS * TYPE_SLOTS>{});
 
-			int64_t expected_len = fmt_ptr->get_min_length();
-			int64_t num_len = cnt_num_len(num_ptr->get_val());
+	constexpr const OptEntry& opt_entry(int64_t opt_type, int64_t type1, int64_t type2) noexcept {
+		size_t op = opt_slot_map[static_cast<uint8_t>(opt_type)];
+		size_t l = type_slot_map[static_cast<uint8_t>(type1)];
+		size_t r = type_slot_map[static_cast<uint8_t>(type2)];
+		return opt_table[(op * TYPE_SLOTS + l) * TYPE_SLOTS + r];
+	}
 
-			int64_t pad = expected_len - num_len;
-			if (pad < 0) pad = 0;
-			for (int64_t i = 0; i < pad; ++i) wss << L"0";
-			wss << num_ptr->get_val();
+	class Add_Int64Opt final : public Int64Opt {
+	public:
+		Add_Int64Opt() : Int64Opt('+', 4) {}
 
-			return std::make_unique<Str>(wss.str());
+		static Element do_opt(const Element& a, const Element& b) {
+			return dispatch('+', a, b);
 		}
+	};
+
+	class Sub_Int64Opt final : public Int64Opt {
+	public:
+		Sub_Int64Opt() : Int64Opt('-', 4) {}
 
-		static const std::unordered_map<uint32_t, OptFunc>& table() {
-			static const std::unordered_map<uint32_t, OptFunc> t{
-				// Z * Z -> Z
-				{ make_key('Z', 'Z'), bind<Int64, Int64>([](const Int64* a, const Int64* b) {
-					return std::make_unique<Int64>((*a) * (*b));
-				}) },
-
-				// Z * F / F * Z -> S (number formatting)
-				{ make_key('Z', 'F'), bind<Int64, Int64_Format>([](const Int64* a, const Int64_Format* b) {
-					return format_with_min_len(a, b);
-				}) },
-				{ make_key('F', 'Z'), bind<Int64_Format, Int64>([](const Int64_Format* a, const Int64* b) {
-					return format_with_min_len(b, a);
-				}) },
-			};
-			return t;
+		static Element do_opt(const Element& a, const Element& b) {
+			return dispatch('-', a, b);
 		}
+	};
 
+	class Mul_Int64Opt final : public Int64Opt {
 	public:
-		virtual std::unique_ptr<Element> do_opt(std::unique_ptr<Element> ptr1, std::unique_ptr<Element> ptr2) override {
-			return dispatch_or_throw(table(), ptr1, ptr2, "Mul");
-		}
+		Mul_Int64Opt() : Int64Opt('*', 3) {}
 
-		static void prewarm_table() {
-			(void)table();
+		static Element do_opt(const Element& a, const Element& b) {
+			return dispatch('*', a, b);
 		}
 	};
 
 	class Div_Int64Opt final : public Int64Opt {
 	public:
-		Div_Int64Opt() { data = 3; }
-		virtual ~Div_Int64Opt() {}
-		constexpr virtual int64_t get_opt_type() override { return '/'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Div_Int64Opt>(*this); }
-
-	private:
-		static const std::unordered_map<uint32_t, OptFunc>& table() {
-			static const std::unordered_map<uint32_t, OptFunc> t{
-				{ make_key('Z', 'Z'), bind<Int64, Int64>([](const Int64* a, const Int64* b) {
-					return std::make_unique<Int64>((*a) / (*b));
-				}) },
-			};
-			return t;
+		Div_Int64Opt() : Int64Opt('/', 3) {}
+
+		static Element do_opt(const Element& a, const Element& b) {
+			return dispatch('/', a, b);
 		}
+	};
 
-	public:
-		virtual std::unique_ptr<Element> do_opt(std::unique_ptr<Element> ptr1, std::unique_ptr<Element> ptr2) override {
-			return dispatch_or_throw(table(), ptr1, ptr2, "Div");
+	inline Element Int64Opt::dispatch(int64_t opt_type, const Element& a, const Element& b) {
+		const OptEntry& entry = opt_entry(opt_type, a.get_type(), b.get_type());
+		if (entry.apply == nullptr) {
+			std::stringstream ss;
+			ss << "Illegal operator type \"" << opt_name(opt_type) << "\" !";
+			throw std::runtime_error(ss.str());
 		}
+		return entry.apply(a, b);
+	}
+
+	inline Element Int64Opt::do_opt(const Element& opt, const Element& a, const Element& b) {
+		int64_t opt_type = opt.get_opt_type();
+		if (opt_slot_map[static_cast<uint8_t>(opt_type)] == OPT_SLOTS - 1) throw std::runtime_error("Illegal data type in preprocessed RPN !");
+		return dispatch(opt_type, a, b);
+	}
 
-		static void prewarm_table() {
-			(void)table();
+	inline int64_t Int64Opt::result_type(int64_t opt_type, int64_t type1, int64_t type2) noexcept {
+		return opt_entry(opt_type, type1, type2).result;
+	}
+
+	inline const char* Int64Opt::opt_name(int64_t opt_type) noexcept {
+		switch (opt_type) {
+			case '+': return "Add";
+			case '-': return "Sub";
+			case '*': return "Mul";
+			case '/': return "Div";
+			default: return "Unknown";
 		}
-	};
+	}
 
 	class Var : public Element {
-	public:
-		Var() = default;
-		virtual ~Var() {}
-		constexpr int64_t get_type() override { return 'X'; }
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Var>(*this); }
-		constexpr virtual int64_t get_var_type() { return 'X'; }
+	protected:
+		Var(int64_t var_type) : Element('X', var_type, 0) {}
 	};
 
 	class Index_Var final : public Var {
 	public:
-		Index_Var() = default;
-		virtual ~Index_Var() {}
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<Index_Var>(*this); }
-		constexpr int64_t get_var_type() override { return 'I'; }
+		Index_Var() : Var('I') {}
 	};
 
 	class OriginFileName_Var final : public Var {
 	public:
-		OriginFileName_Var() = default;
-		virtual ~OriginFileName_Var() {}
-		virtual std::unique_ptr<Element> clone() override { return std::make_unique<OriginFileName_Var>(*this); }
-		constexpr int64_t get_var_type() override { return 'N'; }
+		OriginFileName_Var() : Var('N') {}
 	};
 
 
-	std::vector<std::unique_ptr<calc::Element>> generate_rpn(const std::vector<std::unique_ptr<calc::Element>>& expr) {
-		std::vector<std::unique_ptr<calc::Element>> ret;
-		std::stack<std::unique_ptr<calc::Element>> stk;
+	std::vector<calc::Element> generate_rpn(const std::vector<calc::Element>& expr) {
+		std::vector<calc::Element> ret;
+		std::vector<calc::Element> stk;
+
+		ret.reserve(expr.size());
 
 		size_t obj_cnt = 0;
 		size_t opt_cnt = 0;
 
-		for (auto& ptr : expr) {
-			int64_t type = ptr->get_type();
+		for (auto& elem : expr) {
+			int64_t type = elem.get_type();
 			if (type == 'Z' || type == 'S' || type == 'X' || type == 'F') {
-				ret.emplace_back(ptr->clone());
+				ret.emplace_back(elem);
 				++obj_cnt;
 			} else if (type == '(') {
-				stk.push(ptr->clone());
+				stk.emplace_back(elem);
 			} else if (type == ')') {
 				bool flag = false;
-				std::unique_ptr<calc::Element> top_ptr;
 				while (!stk.empty()) {
-					top_ptr = std::move(stk.top());
-					stk.pop();
-					int64_t top_type = top_ptr->get_type();
+					calc::Element top = std::move(stk.back());
+					stk.pop_back();
+					int64_t top_type = top.get_type();
 					if (top_type == '(') {
 						flag = true;
 						break;
@@ -430,7 +445,7 @@ namespace calc {
 						flag = false;
 						break;
 					} else if (top_type == '#') {
-						ret.emplace_back(std::move(top_ptr));
+						ret.emplace_back(std::move(top));
 						++opt_cnt;
 					}
 				}
@@ -438,39 +453,35 @@ namespace calc {
 				if (flag == false) throw std::runtime_error("Match bracket failed !");
 
 			} else if (type == '#') {
-				calc::Int64Opt* now_ptr = static_cast<calc::Int64Opt*>(ptr.get());
-
 				while (!stk.empty()) {
-					auto& general_top_ptr = stk.top();
-					if (general_top_ptr->get_type() == '(') break;
+					auto& top = stk.back();
+					if (top.get_type() == '(') break;
 
-					if (general_top_ptr->get_type() == '#') {
-						calc::Int64Opt* top_ptr = static_cast<calc::Int64Opt*>(general_top_ptr.get());
-						if (*now_ptr < *top_ptr) {
+					if (top.get_type() == '#') {
+						if (calc::Int64Opt::binds_tighter(elem, top)) {
 							break;
 						} else {
-							ret.emplace_back(std::move(stk.top()));
+							ret.emplace_back(std::move(top));
 							++opt_cnt;
-							stk.pop();
+							stk.pop_back();
 						}
 					} else {
 						throw std::runtime_error("Unexpected element on operator stack !");
 					}
 				}
 
-				stk.push(ptr->clone());
+				stk.emplace_back(elem);
 			}
 		}
 
 		while (!stk.empty()) {
-			auto top_ptr = std::move(stk.top());
-			int64_t top_type = top_ptr->get_type();
+			int64_t top_type = stk.back().get_type();
 
 			if (top_type == '(' || top_type == ')') throw std::runtime_error("Match bracket failed !");
 
-			ret.emplace_back(std::move(top_ptr));
+			ret.emplace_back(std::move(stk.back()));
 			++opt_cnt;
-			stk.pop();
+			stk.pop_back();
 		}
 
 		if (obj_cnt > opt_cnt + 1) throw std::runtime_error("Missing operator !");
@@ -482,24 +493,27 @@ namespace calc {
 
 
 
-	std::vector<std::unique_ptr<calc::Element>> preprocess_rpn(const std::vector<std::unique_ptr<calc::Element>>& rpn, int64_t var_index, const std::wstring& fname) {
-		std::vector<std::unique_ptr<calc::Element>> ret;
+	std::vector<calc::Element> preprocess_rpn(const std::vector<calc::Element>& rpn, int64_t var_index, const std::wstring& fname) {
+		std::vector<calc::Element> ret;
+		ret.reserve(rpn.size());
+
+		// Bound on first use, reused by later occurrences.
+		std::optional<calc::Element> ofname;
 
-		for (auto& ptr : rpn) {
-			int64_t type = ptr->get_type();
+		for (auto& elem : rpn) {
+			int64_t type = elem.get_type();
 			if (type == 'X') {
-				auto var_ptr = static_cast<calc::Var*>(ptr.get());
-				int64_t var_type = var_ptr->get_var_type();
+				int64_t var_type = elem.get_var_type();
 				if (var_type == 'I') {
-					ret.emplace_back(std::make_unique<calc::Int64>(var_index));
+					ret.emplace_back(calc::Int64(var_index));
 				} else if (var_type == 'N') {
-					std::filesystem::path ofp = fname;
-					ret.emplace_back(std::make_unique<calc::Str>(ofp.filename().wstring()));
+					if (!ofname) ofname.emplace(calc::Str(std::filesystem::path(fname).filename().wstring()));
+					ret.emplace_back(*ofname);
 				} else {
 					throw std::runtime_error("Unknown variable type in RPN !");
 				}
 			} else {
-				ret.emplace_back(ptr->clone());
+				ret.emplace_back(elem);
 			}
 		}
 
@@ -509,25 +523,22 @@ namespace calc {
 
 
 
-	std::wstring calculate_rpn(const std::vector<std::unique_ptr<calc::Element>>& rpn) {
-		std::stack<std::unique_ptr<calc::Element>> stk;
+	std::wstring calculate_rpn(const std::vector<calc::Element>& rpn) {
+		std::vector<calc::Element> stk;
+		stk.reserve(rpn.size());
 
-		for (auto& ptr : rpn) {
-			int64_t type = ptr->get_type();
+		for (auto& elem : rpn) {
+			int64_t type = elem.get_type();
 			if (type == 'Z' || type == 'S' || type == 'F') {
-				stk.push(ptr->clone());
+				stk.emplace_back(elem);
 
 			} else if (type == '#') {
 				if (stk.size() < 2) throw std::runtime_error("Illegal expression !");
 
-				auto v_ptr = std::move(stk.top());
-				stk.pop();
-				auto u_ptr = std::move(stk.top());
-				stk.pop();
+				calc::Element v = std::move(stk.back());
+				stk.pop_back();
 
-				auto opt_ptr = static_cast<Int64Opt*>(ptr.get());
-
-				stk.push(opt_ptr->do_opt(std::move(u_ptr), std::move(v_ptr)));
+				stk.back() = Int64Opt::do_opt(elem, stk.back(), v);
 
 			} else {
 				throw std::runtime_error("Illegal data type in preprocessed RPN !");
@@ -539,26 +550,15 @@ namespace calc {
 
 		if (stk.size() != 1) throw std::runtime_error("Illegal expression !");
 
-		auto top_ptr = std::move(stk.top());
-		int64_t top_type = top_ptr->get_type();
-		std::wstringstream ss;
+		const calc::Element& top = stk.back();
+		int64_t top_type = top.get_type();
 
-		if (top_type == 'Z') ss << (*static_cast<Int64*>(top_ptr.get()));
-		else if (top_type == 'S') ss << (*static_cast<Str*>(top_ptr.get()));
+		if (top_type == 'Z' || top_type == 'S') return top.get_str();
 		else throw std::runtime_error("Illegal data type in preprocessed RPN !");
-
-		return ss.str();
 	}
 
-	// Call this once during program startup to pre-initialize operator dispatch tables.
-	inline void warmup_operator_tables() {
-		Add_Int64Opt::prewarm_table();
-		Sub_Int64Opt::prewarm_table();
-		Mul_Int64Opt::prewarm_table();
-		Div_Int64Opt::prewarm_table();
-	}
 
 
 } // namespace calc
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,218 @@
+﻿#ifndef _CALC_BATCH_HPP
+#define _CALC_BATCH_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "calc_format.hpp"
+#include "calc_program.hpp"
+
+namespace calc {
+
+	// Columnar evaluation of a Program over a block of files.
+	//
+	// Instead of running every instruction once per file, each instruction runs once
+	// over a whole column of rows: stack slot k holds a column of numbers and a column of
+	// string spans (offset + length into one shared arena). Numeric operators become
+	// plain loops over int64_t arrays, and every string operation sizes its output for the
+	// whole column first, so the arena grows at most once per instruction.
+	//
+	// Rows are files first_index, first_index + 1, ...; callers feed large batches in
+	// blocks of CHUNK_ROWS so the arena stays bounded. All buffers keep their capacity
+	// between blocks.
+	class BatchEvaluator {
+	public:
+		static constexpr size_t CHUNK_ROWS = 4096;
+
+	private:
+		struct Span {
+			size_t off;
+			size_t len;
+		};
+
+		std::vector<std::vector<int64_t>> num_;
+		std::vector<std::vector<Span>> str_;
+		std::vector<Span> names_;
+		std::vector<size_t> ends_;
+		std::wstring arena_;
+		size_t rows_ = 0;
+
+		// Replaces the numbers of slot sp by their text, padded to min_len digits.
+		void format_slot(size_t sp, int64_t min_len) {
+			const int64_t* nums = num_[sp].data();
+			Span* spans = str_[sp].data();
+
+			size_t total = 0;
+			for (size_t i = 0; i < rows_; ++i) total += formatted_length(nums[i], min_len);
+
+			size_t base = arena_.size();
+			arena_.resize(base + total);
+			format_column(nums, rows_, min_len, arena_.data() + base, ends_.data());
+
+			size_t prev = 0;
+			for (size_t i = 0; i < rows_; ++i) {
+				spans[i] = { base + prev, ends_[i] - prev };
+				prev = ends_[i];
+			}
+		}
+
+		// Joins slots sp .. sp + n - 1 row by row into slot sp.
+		void concat_slots(size_t sp, size_t n) {
+			size_t total = 0;
+			for (size_t k = sp; k < sp + n; ++k) {
+				const Span* spans = str_[k].data();
+				for (size_t i = 0; i < rows_; ++i) total += spans[i].len;
+			}
+
+			size_t pos = arena_.size();
+			arena_.resize(pos + total);
+			wchar_t* data = arena_.data();
+
+			Span* out = str_[sp].data();
+			for (size_t i = 0; i < rows_; ++i) {
+				size_t start = pos;
+				for (size_t k = sp; k < sp + n; ++k) {
+					const Span& piece = str_[k][i];
+					std::memcpy(data + pos, data + piece.off, piece.len * sizeof(wchar_t));
+					pos += piece.len;
+				}
+				out[i] = { start, pos - start };
+			}
+		}
+
+		// Pushes the text of scale * INDEX + offset for every row into slot sp.
+		void format_affine(size_t sp, const Affine& f, int64_t first_index) {
+			int64_t first = static_cast<int64_t>(static_cast<uint64_t>(f.scale) * static_cast<uint64_t>(first_index) + static_cast<uint64_t>(f.offset));
+
+			size_t base = arena_.size();
+			arena_.resize(base + sequence_length_bound(first, f.scale, rows_, f.min_len));
+			size_t total = format_sequence(first, f.scale, rows_, f.min_len, arena_.data() + base, ends_.data());
+			arena_.resize(base + total);
+
+			Span* spans = str_[sp].data();
+			size_t prev = 0;
+			for (size_t i = 0; i < rows_; ++i) {
+				spans[i] = { base + prev, ends_[i] - prev };
+				prev = ends_[i];
+			}
+		}
+
+		void bind_names(const std::wstring_view* names) {
+			size_t total = 0;
+			for (size_t i = 0; i < rows_; ++i) total += names[i].size();
+
+			size_t pos = arena_.size();
+			arena_.resize(pos + total);
+			wchar_t* data = arena_.data();
+
+			names_.resize(rows_);
+			for (size_t i = 0; i < rows_; ++i) {
+				std::memcpy(data + pos, names[i].data(), names[i].size() * sizeof(wchar_t));
+				names_[i] = { pos, names[i].size() };
+				pos += names[i].size();
+			}
+		}
+
+	public:
+		// Evaluates prog for rows files; names[i] is the OFNAME of file first_index + i.
+		// names is only read when prog uses OFNAME (and may be null otherwise); the names
+		// are copied into the arena once per block however often OFNAME occurs.
+		void run(const Program& prog, int64_t first_index, const std::wstring_view* names, size_t rows) {
+			rows_ = rows;
+			arena_.clear();
+			names_.clear();
+
+			size_t depth = std::max<size_t>(prog.max_depth(), 1);
+			if (num_.size() < depth) {
+				num_.resize(depth);
+				str_.resize(depth);
+			}
+			for (size_t k = 0; k < depth; ++k) {
+				num_[k].resize(rows);
+				str_[k].resize(rows);
+			}
+			ends_.resize(rows);
+
+			const std::wstring& pool = prog.pool();
+			size_t sp = 0;	// number of occupied slots
+
+			for (const Instr& ins : prog.code()) {
+				switch (ins.op) {
+					case OpCode::PUSH_INT:
+						std::fill(num_[sp].begin(), num_[sp].end(), ins.arg);
+						++sp;
+						break;
+					case OpCode::PUSH_STR:
+					{
+						Span span{ arena_.size(), ins.len };
+						arena_.append(pool, static_cast<size_t>(ins.arg), ins.len);
+						std::fill(str_[sp].begin(), str_[sp].end(), span);
+						++sp;
+						break;
+					}
+					case OpCode::LOAD_INDEX:
+					{
+						int64_t* col = num_[sp].data();
+						for (size_t i = 0; i < rows; ++i) col[i] = first_index + static_cast<int64_t>(i);
+						++sp;
+						break;
+					}
+					case OpCode::LOAD_AFFINE:
+					{
+						const Affine& f = prog.affine()[static_cast<size_t>(ins.arg)];
+						uint64_t x = static_cast<uint64_t>(f.scale) * static_cast<uint64_t>(first_index) + static_cast<uint64_t>(f.offset);
+						int64_t* col = num_[sp].data();
+						for (size_t i = 0; i < rows; ++i, x += static_cast<uint64_t>(f.scale)) col[i] = static_cast<int64_t>(x);
+						++sp;
+						break;
+					}
+					case OpCode::FMT_AFFINE:
+						format_affine(sp, prog.affine()[static_cast<size_t>(ins.arg)], first_index);
+						++sp;
+						break;
+					case OpCode::LOAD_OFNAME:
+						if (names_.empty() && rows) bind_names(names);
+						std::copy(names_.begin(), names_.end(), str_[sp].begin());
+						++sp;
+						break;
+					case OpCode::FMT:
+						format_slot(sp - 1, ins.arg);
+						break;
+					case OpCode::CONCAT:
+						sp -= ins.len - 1;
+						concat_slots(sp - 1, ins.len);
+						break;
+					default:
+					{
+						--sp;
+						int64_t* u = num_[sp - 1].data();
+						const int64_t* v = num_[sp].data();
+						switch (ins.op) {
+							case OpCode::ADD: for (size_t i = 0; i < rows; ++i) u[i] = int64_add(u[i], v[i]); break;
+							case OpCode::SUB: for (size_t i = 0; i < rows; ++i) u[i] = int64_sub(u[i], v[i]); break;
+							case OpCode::MUL: for (size_t i = 0; i < rows; ++i) u[i] = int64_mul(u[i], v[i]); break;
+							case OpCode::DIV: for (size_t i = 0; i < rows; ++i) u[i] = int64_div(u[i], v[i]); break;
+							default: break;
+						}
+						break;
+					}
+				}
+			}
+		}
+
+		size_t size() const { return rows_; }
+
+		// New name of row i of the last run; valid until the next run.
+		std::wstring_view result(size_t row) const {
+			const Span& span = str_[0][row];
+			return std::wstring_view(arena_).substr(span.off, span.len);
+		}
+	};
+
+} // namespace calc
+
+#endif // !_CALC_BATCH_HPP
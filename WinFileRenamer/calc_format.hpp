@@ -0,0 +1,183 @@
+﻿#ifndef _CALC_FORMAT_HPP
+#define _CALC_FORMAT_HPP
+
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace calc {
+
+	// Integer to text without streams.
+	// Digits are written back to front two at a time from a digit-pair table, and the
+	// digit count comes from the bit width instead of a divide loop, so callers can size
+	// the output exactly and write it in place.
+	//
+	// Padding follows Mul_Int64Opt: min_len counts digits only, and the zeros are written
+	// in front of the sign ("00-5" for -5 with a minimum length of 3).
+
+	inline constexpr char digit_pairs[201] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+	inline constexpr uint64_t pow10_table[20] = {
+		1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+		100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+		10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+		100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
+	};
+
+	// Largest output of format_int(), sign included.
+	inline constexpr size_t MAX_INT_CHARS = 20;
+
+	constexpr uint64_t magnitude(int64_t x) noexcept {
+		// handle negative + INT64_MIN safely
+		return (x < 0) ? (0ULL - static_cast<uint64_t>(x)) : static_cast<uint64_t>(x);
+	}
+
+	// Number of decimal digits of u, 1 for 0.
+	constexpr int count_digits(uint64_t u) noexcept {
+		u |= 1;
+		int t = (static_cast<int>(std::bit_width(u)) * 1233) >> 12;
+		return t + 1 - static_cast<int>(u < pow10_table[t]);
+	}
+
+	// Writes the digits of u so that they end at end; returns the first written position.
+	inline wchar_t* write_digits_backward(wchar_t* end, uint64_t u) noexcept {
+		while (u >= 100) {
+			const char* pair = digit_pairs + (u % 100) * 2;
+			u /= 100;
+			*--end = static_cast<wchar_t>(pair[1]);
+			*--end = static_cast<wchar_t>(pair[0]);
+		}
+		if (u >= 10) {
+			const char* pair = digit_pairs + u * 2;
+			*--end = static_cast<wchar_t>(pair[1]);
+			*--end = static_cast<wchar_t>(pair[0]);
+		} else {
+			*--end = static_cast<wchar_t>(L'0' + u);
+		}
+		return end;
+	}
+
+	constexpr size_t formatted_length(int64_t x, int64_t min_len = 0) noexcept {
+		int64_t digits = count_digits(magnitude(x));
+		return static_cast<size_t>((min_len > digits) ? min_len : digits) + (x < 0 ? 1 : 0);
+	}
+
+	// Writes x padded to min_len digits at out, which must hold formatted_length(x, min_len)
+	// characters. Returns the number of characters written.
+	inline size_t format_int(wchar_t* out, int64_t x, int64_t min_len = 0) noexcept {
+		size_t len = formatted_length(x, min_len);
+		wchar_t* begin = write_digits_backward(out + len, magnitude(x));
+		if (x < 0) *--begin = L'-';
+		while (begin != out) *--begin = L'0';
+		return len;
+	}
+
+	inline void append_int(std::wstring& dst, int64_t x, int64_t min_len = 0) {
+		size_t before = dst.size();
+		dst.resize(before + formatted_length(x, min_len));
+		format_int(dst.data() + before, x, min_len);
+	}
+
+	inline std::wstring int_to_wstring(int64_t x, int64_t min_len = 0) {
+		std::wstring s;
+		append_int(s, x, min_len);
+		return s;
+	}
+
+	// Batch form for an arithmetic sequence first, first + step, ... (INDEX and affine
+	// functions of it). The values are written back to back into out; ends[i] receives the
+	// end offset of value i. Returns the total number of characters, which never exceeds
+	// sequence_length_bound(first, step, count, min_len).
+
+	// Last term of a count-term sequence; false if some term leaves int64_t.
+	constexpr bool sequence_last(int64_t first, int64_t step, size_t count, int64_t& last) noexcept {
+		uint64_t n = (count == 0) ? 0 : static_cast<uint64_t>(count - 1);
+		uint64_t room = (step >= 0)
+			? static_cast<uint64_t>(INT64_MAX) - static_cast<uint64_t>(first)
+			: static_cast<uint64_t>(first) - static_cast<uint64_t>(INT64_MIN);
+		if (n != 0 && magnitude(step) > room / n) return false;
+		last = static_cast<int64_t>(static_cast<uint64_t>(first) + static_cast<uint64_t>(step) * n);
+		return true;
+	}
+
+	inline size_t sequence_length_bound(int64_t first, int64_t step, size_t count, int64_t min_len) noexcept {
+		if (count == 0) return 0;
+		int64_t last = 0;
+		if (!sequence_last(first, step, count, last)) return formatted_length(INT64_MIN, min_len) * count;
+		// Lengths grow with magnitude, so the widest term is an end point.
+		size_t widest = formatted_length(first, min_len);
+		size_t w = formatted_length(last, min_len);
+		if (w > widest) widest = w;
+		return widest * count;
+	}
+
+	// Non-negative increasing sequences keep the previous term as a decimal counter: it is
+	// copied forward and step is added digit by digit with carry, so most terms cost one
+	// short copy and a digit or two. Only a carry out of the leading digit (the text gets
+	// longer) falls back to a full format. Anything else is formatted term by term.
+	inline size_t format_sequence(int64_t first, int64_t step, size_t count, int64_t min_len, wchar_t* out, size_t* ends) noexcept {
+		if (count == 0) return 0;
+
+		int64_t last = 0;
+		if (first < 0 || step <= 0 || !sequence_last(first, step, count, last)) {
+			size_t pos = 0;
+			uint64_t x = static_cast<uint64_t>(first);
+			for (size_t i = 0; i < count; ++i, x += static_cast<uint64_t>(step)) {
+				pos += format_int(out + pos, static_cast<int64_t>(x), min_len);
+				ends[i] = pos;
+			}
+			return pos;
+		}
+
+		const uint64_t ustep = static_cast<uint64_t>(step);
+		size_t len = format_int(out, first, min_len);
+		size_t pos = len;
+		ends[0] = pos;
+
+		int64_t x = first;
+		for (size_t i = 1; i < count; ++i) {
+			x += step;
+			wchar_t* cur = out + pos;
+			const wchar_t* prev = cur - len;
+			for (size_t k = 0; k < len; ++k) cur[k] = prev[k];
+
+			uint64_t carry = ustep;
+			wchar_t* p = cur + len;
+			while (carry != 0 && p != cur) {
+				--p;
+				uint64_t v = static_cast<uint64_t>(*p - L'0') + carry;
+				*p = static_cast<wchar_t>(L'0' + v % 10);
+				carry = v / 10;
+			}
+			if (carry != 0) len = format_int(cur, x, min_len);
+
+			pos += len;
+			ends[i] = pos;
+		}
+		return pos;
+	}
+
+	// Same as format_sequence() for an arbitrary column of values.
+	inline size_t format_column(const int64_t* values, size_t count, int64_t min_len, wchar_t* out, size_t* ends) noexcept {
+		size_t pos = 0;
+		for (size_t i = 0; i < count; ++i) {
+			pos += format_int(out + pos, values[i], min_len);
+			ends[i] = pos;
+		}
+		return pos;
+	}
+
+} // namespace calc
+
+#endif // !_CALC_FORMAT_HPP
@@ -0,0 +1,280 @@
+﻿#ifndef _CALC_INCREMENTAL_HPP
+#define _CALC_INCREMENTAL_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <exception>
+
+#include "calc.hpp"
+#include "calc_program.hpp"
+
+namespace calc {
+
+	// Infix token list with its RPN, typed tree and validity maintained as tokens are
+	// pushed and popped, for live validation and preview of long expressions.
+	//
+	// The shunting-yard state is checkpointed after every token. The RPN output only grows
+	// while tokens are pushed, so a checkpoint just records its length; the operator stack
+	// is persistent (a parent-linked list of nodes in an arena), so a checkpoint records its
+	// top. The typed tree follows the output one node per RPN element, as in ExprTree::build,
+	// and its value stack is persistent in the same way. Pushing a token is amortized O(1),
+	// popping one is O(1) plus the RPN elements it had emitted.
+	//
+	// Operators still on the stack at the end are applied when the status or the program
+	// is requested, which costs O(pending operators). status() stops there; compile() then
+	// copies the tree and emits the program from it, which is O(tokens), since no program
+	// is kept per checkpoint: a preview compiles once per edit, and only parsing is saved.
+	// status() and compile() give the same errors as compile(generate_rpn(tokens())).
+	class IncrementalRpn {
+	private:
+		static constexpr uint32_t NONE = 0xffffffffu;
+
+		enum : uint8_t {
+			ERR_NONE,
+			ERR_BRACKET,
+		};
+
+		struct OpNode {
+			uint32_t token;		// index into tokens_, a '(' or '#'
+			uint32_t below;
+			uint32_t opens;		// '(' in this node and the ones below
+		};
+
+		struct Checkpoint {
+			uint32_t out_len = 0;
+			uint32_t op_top = NONE;
+			uint32_t op_nodes = 0;
+			uint32_t obj_cnt = 0;
+			uint32_t opt_cnt = 0;		// operators pushed, emitted or not
+			uint8_t err = ERR_NONE;
+		};
+
+		std::vector<Element> tokens_;
+		std::vector<Checkpoint> checkpoints_;	// state after tokens_[i]
+		std::vector<OpNode> ops_;
+
+		// RPN output (token indices) and the tree node of every output position.
+		std::vector<uint32_t> out_;
+		std::vector<ExprNode> nodes_;
+		std::vector<uint32_t> below_;			// value stack under node i
+		std::vector<uint32_t> depth_;			// value stack depth with node i on top
+
+		// First error while building the tree; positions past it hold placeholder nodes.
+		uint32_t tree_err_pos_ = NONE;
+		std::string tree_err_;
+
+		mutable bool status_valid_ = false;
+		mutable std::string status_;
+
+		Checkpoint state() const {
+			return checkpoints_.empty() ? Checkpoint{} : checkpoints_.back();
+		}
+
+		void emit(uint32_t token) {
+			uint32_t pos = static_cast<uint32_t>(out_.size());
+			out_.push_back(token);
+
+			const Element& elem = tokens_[token];
+			uint32_t top = (pos == 0) ? NONE : pos - 1;
+			uint32_t depth = (top == NONE) ? 0 : depth_[top];
+
+			ExprNode node;
+			uint32_t below = top;
+
+			if (tree_err_pos_ == NONE) {
+				try {
+					if (elem.get_type() == '#') {
+						if (depth < 2) throw std::runtime_error("Illegal expression !");
+						uint32_t rhs = top;
+						uint32_t lhs = below_[rhs];
+						node = ExprTree::make_op(elem, lhs, nodes_[lhs], rhs, nodes_[rhs]);
+						below = below_[lhs];
+						depth -= 2;
+					} else {
+						node = ExprTree::make_leaf(elem);
+					}
+				} catch (const std::exception& e) {
+					tree_err_pos_ = pos;
+					tree_err_ = e.what();
+					node = ExprNode();
+				}
+			}
+
+			nodes_.emplace_back(std::move(node));
+			below_.push_back(below);
+			depth_.push_back(depth + 1);
+		}
+
+		void truncate_output(uint32_t len) {
+			out_.resize(len);
+			nodes_.resize(len);
+			below_.resize(len);
+			depth_.resize(len);
+			if (tree_err_pos_ != NONE && tree_err_pos_ >= len) {
+				tree_err_pos_ = NONE;
+				tree_err_.clear();
+			}
+		}
+
+		// Applies the operators left on the stack to the value stack and type checks the
+		// result. Pending nodes go to extra with ids nodes_.size() + j. Throws what
+		// generate_rpn() or ExprTree::build() would throw.
+		uint32_t finish(std::vector<ExprNode>& extra) const {
+			Checkpoint s = state();
+
+			if (s.err == ERR_BRACKET) throw std::runtime_error("Match bracket failed !");
+			if (s.op_top != NONE && ops_[s.op_top].opens != 0) throw std::runtime_error("Match bracket failed !");
+			if (s.obj_cnt > s.opt_cnt + 1) throw std::runtime_error("Missing operator !");
+			if (s.obj_cnt < s.opt_cnt + 1) throw std::runtime_error("Exceeding operator !");
+			if (tree_err_pos_ != NONE) throw std::runtime_error(tree_err_);
+
+			const uint32_t n = static_cast<uint32_t>(nodes_.size());
+			auto node_at = [&](uint32_t id) -> const ExprNode& { return (id < n) ? nodes_[id] : extra[id - n]; };
+
+			// Value stack: the persistent part below, then the pending results in stk.
+			uint32_t real_top = (n == 0) ? NONE : n - 1;
+			std::vector<uint32_t> stk;
+			auto pop_value = [&]() -> uint32_t {
+				if (!stk.empty()) {
+					uint32_t id = stk.back();
+					stk.pop_back();
+					return id;
+				}
+				if (real_top == NONE) throw std::runtime_error("Illegal expression !");
+				uint32_t id = real_top;
+				real_top = below_[id];
+				return id;
+			};
+			auto depth = [&]() -> size_t { return stk.size() + ((real_top == NONE) ? 0 : depth_[real_top]); };
+
+			for (uint32_t k = s.op_top; k != NONE; k = ops_[k].below) {
+				if (depth() < 2) throw std::runtime_error("Illegal expression !");
+				uint32_t rhs = pop_value();
+				uint32_t lhs = pop_value();
+				extra.emplace_back(ExprTree::make_op(tokens_[ops_[k].token], lhs, node_at(lhs), rhs, node_at(rhs)));
+				stk.push_back(n + static_cast<uint32_t>(extra.size() - 1));
+			}
+
+			if (depth() != 1) throw std::runtime_error("Illegal expression !");
+			uint32_t root = pop_value();
+			ExprTree::check_root_type(node_at(root).type);
+			return root;
+		}
+
+		void refresh_status() const {
+			if (status_valid_) return;
+			status_valid_ = true;
+			status_.clear();
+
+			std::vector<ExprNode> extra;
+			try {
+				finish(extra);
+			} catch (const std::exception& e) {
+				status_ = e.what();
+			}
+		}
+
+	public:
+		void push(const Element& token) {
+			status_valid_ = false;
+
+			Checkpoint s = state();
+			uint32_t idx = static_cast<uint32_t>(tokens_.size());
+			tokens_.push_back(token);
+
+			// generate_rpn() stops at its first error; so does the checkpointed state.
+			if (s.err != ERR_NONE) {
+				checkpoints_.push_back(s);
+				return;
+			}
+
+			int64_t type = token.get_type();
+			if (type == 'Z' || type == 'S' || type == 'X' || type == 'F') {
+				emit(idx);
+				++s.obj_cnt;
+			} else if (type == '(') {
+				uint32_t opens = (s.op_top == NONE) ? 0 : ops_[s.op_top].opens;
+				ops_.push_back({ idx, s.op_top, opens + 1 });
+				s.op_top = static_cast<uint32_t>(ops_.size() - 1);
+			} else if (type == ')') {
+				bool flag = false;
+				while (s.op_top != NONE) {
+					const OpNode& top = ops_[s.op_top];
+					s.op_top = top.below;
+					if (tokens_[top.token].get_type() == '(') {
+						flag = true;
+						break;
+					}
+					emit(top.token);
+				}
+				if (!flag) s.err = ERR_BRACKET;
+			} else if (type == '#') {
+				while (s.op_top != NONE) {
+					const OpNode& top = ops_[s.op_top];
+					const Element& top_elem = tokens_[top.token];
+					if (top_elem.get_type() == '(') break;
+					if (Int64Opt::binds_tighter(token, top_elem)) break;
+					emit(top.token);
+					s.op_top = top.below;
+				}
+				++s.opt_cnt;
+				uint32_t opens = (s.op_top == NONE) ? 0 : ops_[s.op_top].opens;
+				ops_.push_back({ idx, s.op_top, opens });
+				s.op_top = static_cast<uint32_t>(ops_.size() - 1);
+			}
+
+			s.out_len = static_cast<uint32_t>(out_.size());
+			s.op_nodes = static_cast<uint32_t>(ops_.size());
+			checkpoints_.push_back(s);
+		}
+
+		// Undoes the last push; does nothing when empty.
+		void pop() {
+			if (tokens_.empty()) return;
+			status_valid_ = false;
+
+			tokens_.pop_back();
+			checkpoints_.pop_back();
+
+			Checkpoint s = state();
+			truncate_output(s.out_len);
+			ops_.resize(s.op_nodes);
+		}
+
+		void clear() {
+			status_valid_ = false;
+			tokens_.clear();
+			checkpoints_.clear();
+			ops_.clear();
+			truncate_output(0);
+		}
+
+		bool empty() const { return tokens_.empty(); }
+		size_t size() const { return tokens_.size(); }
+		const std::vector<Element>& tokens() const { return tokens_; }
+
+		// Empty when the expression compiles; otherwise the error compile() would throw.
+		const std::string& status() const {
+			refresh_status();
+			return status_;
+		}
+
+		// Same as calc::compile(generate_rpn(tokens())), reusing the maintained tree. O(tokens).
+		Program compile() const {
+			std::vector<ExprNode> extra;
+			uint32_t root = finish(extra);
+
+			ExprTree tree;
+			tree.nodes.reserve(nodes_.size() + extra.size());
+			tree.nodes = nodes_;
+			for (auto& node : extra) tree.nodes.emplace_back(std::move(node));
+			tree.root = root;
+			return calc::compile(tree);
+		}
+	};
+
+} // namespace calc
+
+#endif // !_CALC_INCREMENTAL_HPP
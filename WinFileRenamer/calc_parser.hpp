@@ -0,0 +1,210 @@
+﻿#ifndef _CALC_PARSER_HPP
+#define _CALC_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+
+#include "calc.hpp"
+#include "calc_program.hpp"
+#include "calc_incremental.hpp"
+
+namespace calc {
+
+	// Reads the textual form the expression preview shows, e.g.
+	//     "MyVideo_" + ( INDEX + 1 ) * NUM_FORMAT_3 + ".mp4"
+	// Tokens are separated by optional whitespace. Strings are double-quoted; \" and \\ are
+	// the only escapes inside them. A '-' directly followed by a digit starts a negative number
+	// unless it is glued to the end of an operand: "INDEX-1" subtracts, while "INDEX -1" is
+	// INDEX followed by -1, which is how the preview shows that token list.
+	//
+	// The tokenizer only hands out views into the source; the one allocation per token is
+	// a string constant too long for the Element's inline buffer.
+
+	enum class TokenKind : uint8_t {
+		END,
+		STR,
+		INT,
+		INDEX,
+		OFNAME,
+		FORMAT,
+		ADD,
+		SUB,
+		MUL,
+		DIV,
+		LBRACKET,
+		RBRACKET,
+	};
+
+	struct Token {
+		TokenKind kind = TokenKind::END;
+		std::wstring_view text;		// string contents without the quotes, still escaped
+		int64_t value = 0;			// INT and FORMAT
+		bool escaped = false;		// text contains a backslash escape
+		size_t pos = 0;				// offset of the token in the source
+	};
+
+	class Tokenizer {
+	public:
+		// Largest NUM_FORMAT_<n>, the same limit the input box applies.
+		static constexpr int64_t MAX_FORMAT_LEN = 100;
+
+	private:
+		std::wstring_view src_;
+		size_t pos_ = 0;
+		size_t operand_end_ = SIZE_MAX;		// end of the last token if it was an operand
+
+		static bool is_space(wchar_t c) {
+			return c == L' ' || c == L'\t' || c == L'\r' || c == L'\n' || c == 0x3000;
+		}
+
+		static bool is_digit(wchar_t c) {
+			return c >= L'0' && c <= L'9';
+		}
+
+		static bool is_ident(wchar_t c) {
+			return (c >= L'A' && c <= L'Z') || (c >= L'a' && c <= L'z') || is_digit(c) || c == L'_';
+		}
+
+		[[noreturn]] static void fail(const char* what, size_t pos) {
+			throw std::runtime_error(std::string(what) + " at position " + std::to_string(pos) + " !");
+		}
+
+		// Reads the digits at pos_ as the magnitude of a number with the given sign.
+		int64_t read_number(bool neg, size_t start) {
+			uint64_t mag = 0;
+			const uint64_t limit = static_cast<uint64_t>(INT64_MAX) + (neg ? 1 : 0);
+			while (pos_ < src_.size() && is_digit(src_[pos_])) {
+				uint64_t d = static_cast<uint64_t>(src_[pos_] - L'0');
+				if (mag > (limit - d) / 10) fail("Number out of range", start);
+				mag = mag * 10 + d;
+				++pos_;
+			}
+			if (pos_ < src_.size() && is_ident(src_[pos_])) fail("Illegal number", start);
+			return neg ? static_cast<int64_t>(0ULL - mag) : static_cast<int64_t>(mag);
+		}
+
+	public:
+		explicit Tokenizer(std::wstring_view src) : src_(src) {}
+
+		// Returns the next token, END at the end of the source. Throws on malformed input.
+		Token next() {
+			while (pos_ < src_.size() && is_space(src_[pos_])) ++pos_;
+
+			Token tok;
+			tok.pos = pos_;
+			if (pos_ == src_.size()) return tok;
+
+			const wchar_t c = src_[pos_];
+			bool operand = true;
+
+			if (c == L'"') {
+				size_t begin = ++pos_;
+				while (true) {
+					if (pos_ == src_.size()) fail("Unterminated string", tok.pos);
+					wchar_t d = src_[pos_];
+					if (d == L'"') break;
+					if (d == L'\\') {
+						if (pos_ + 1 == src_.size() || (src_[pos_ + 1] != L'"' && src_[pos_ + 1] != L'\\')) fail("Illegal escape", pos_);
+						tok.escaped = true;
+						++pos_;
+					}
+					++pos_;
+				}
+				tok.kind = TokenKind::STR;
+				tok.text = src_.substr(begin, pos_ - begin);
+				++pos_;
+			} else if (is_digit(c) || (c == L'-' && pos_ != operand_end_ && pos_ + 1 < src_.size() && is_digit(src_[pos_ + 1]))) {
+				bool neg = (c == L'-');
+				if (neg) ++pos_;
+				tok.kind = TokenKind::INT;
+				tok.value = read_number(neg, tok.pos);
+			} else if (is_ident(c)) {
+				constexpr std::wstring_view fmt_prefix = L"NUM_FORMAT_";
+				size_t begin = pos_;
+				while (pos_ < src_.size() && is_ident(src_[pos_])) ++pos_;
+				std::wstring_view word = src_.substr(begin, pos_ - begin);
+
+				if (word == L"INDEX") {
+					tok.kind = TokenKind::INDEX;
+				} else if (word == L"OFNAME") {
+					tok.kind = TokenKind::OFNAME;
+				} else if (word.substr(0, fmt_prefix.size()) == fmt_prefix && word.size() > fmt_prefix.size()) {
+					int64_t len = 0;
+					for (wchar_t d : word.substr(fmt_prefix.size())) {
+						if (!is_digit(d)) fail("Unknown identifier", tok.pos);
+						len = len * 10 + (d - L'0');
+						if (len > MAX_FORMAT_LEN) fail("Number format out of range", tok.pos);
+					}
+					tok.kind = TokenKind::FORMAT;
+					tok.value = len;
+				} else {
+					fail("Unknown identifier", tok.pos);
+				}
+			} else {
+				switch (c) {
+					case L'+': tok.kind = TokenKind::ADD; break;
+					case L'-': tok.kind = TokenKind::SUB; break;
+					case L'*': tok.kind = TokenKind::MUL; break;
+					case L'/': tok.kind = TokenKind::DIV; break;
+					case L'(': tok.kind = TokenKind::LBRACKET; break;
+					case L')': tok.kind = TokenKind::RBRACKET; break;
+					default: fail("Unexpected character", tok.pos);
+				}
+				operand = (c == L')');
+				++pos_;
+			}
+
+			operand_end_ = operand ? pos_ : SIZE_MAX;
+			return tok;
+		}
+	};
+
+	// Builds the element a token stands for; STR tokens are unescaped through scratch.
+	inline Element make_element(const Token& tok, std::wstring& scratch) {
+		switch (tok.kind) {
+			case TokenKind::STR:
+				if (!tok.escaped) return Str(tok.text);
+				scratch.clear();
+				for (size_t i = 0; i < tok.text.size(); ++i) {
+					if (tok.text[i] == L'\\') ++i;
+					scratch.push_back(tok.text[i]);
+				}
+				return Str(std::wstring_view(scratch));
+			case TokenKind::INT: return Int64(tok.value);
+			case TokenKind::INDEX: return Index_Var();
+			case TokenKind::OFNAME: return OriginFileName_Var();
+			case TokenKind::FORMAT: return Int64_Format(tok.value);
+			case TokenKind::ADD: return Add_Int64Opt();
+			case TokenKind::SUB: return Sub_Int64Opt();
+			case TokenKind::MUL: return Mul_Int64Opt();
+			case TokenKind::DIV: return Div_Int64Opt();
+			case TokenKind::LBRACKET: return Lbracket();
+			case TokenKind::RBRACKET: return Rbracket();
+			default: throw std::runtime_error("Illegal token !");
+		}
+	}
+
+	// Appends the tokens of src to out. Only syntax errors throw; whether the expression is
+	// well formed is left to out.status() / out.compile(), as for tokens pushed one by one.
+	inline void parse_expression(std::wstring_view src, IncrementalRpn& out) {
+		Tokenizer tz(src);
+		std::wstring scratch;
+		for (Token tok = tz.next(); tok.kind != TokenKind::END; tok = tz.next()) {
+			out.push(make_element(tok, scratch));
+		}
+	}
+
+	// Text straight to Program; throws what parse_expression() or compile() would throw.
+	inline Program compile_text(std::wstring_view src) {
+		IncrementalRpn expr;
+		parse_expression(src, expr);
+		if (expr.empty()) throw std::runtime_error("Empty expression !");
+		return expr.compile();
+	}
+
+} // namespace calc
+
+#endif // !_CALC_PARSER_HPP
@@ -0,0 +1,352 @@
+﻿#ifndef _CALC_PROGRAM_HPP
+#define _CALC_PROGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <sstream>
+
+#include "calc.hpp"
+
+namespace calc {
+
+	// Compiled form of the RPN produced by generate_rpn().
+	// The expression is compiled once per job; evaluating it per file walks a flat
+	// instruction array with no virtual calls and no per-token heap allocation.
+	//
+	// Compilation first builds a typed ExprTree: every operator is type checked once,
+	// so a bad expression is rejected before any file is touched, and subtrees that use
+	// no variables are folded into constants. The emitted instructions are specialised
+	// by operand type, so the evaluator never inspects value types.
+	// A chain of string '+' is emitted as one CONCAT over all of its operands: each
+	// operand is written into the arena once, in order, and the CONCAT only merges
+	// their lengths, instead of k pairwise copies of a growing string.
+	// Numeric subtrees built from INDEX, constants, '+', '-' and multiplication by a
+	// constant are recognised as scale * INDEX + offset. They load in one step, and when
+	// they are formatted the batch evaluator steps the decimal text as a counter instead
+	// of recomputing and reformatting every term.
+
+	struct ExprNode {
+		int64_t type = 0;		// result type: 'Z', 'S' or 'F'
+		int64_t op = 0;			// '+', '-', '*', '/' for operators, 0 for leaves
+		int64_t var = 0;		// 'I' or 'N' for variable leaves, 0 otherwise
+		uint32_t lhs = 0;
+		uint32_t rhs = 0;
+		Element value;			// constant leaves only
+
+		bool is_const() const noexcept { return op == 0 && var == 0; }
+	};
+
+	class ExprTree {
+	public:
+		std::vector<ExprNode> nodes;
+		uint32_t root = 0;
+
+		const ExprNode& operator[](uint32_t id) const { return nodes[id]; }
+
+		// Node for an operand or variable element.
+		static ExprNode make_leaf(const Element& elem) {
+			int64_t type = elem.get_type();
+			ExprNode node;
+
+			if (type == 'Z' || type == 'S' || type == 'F') {
+				node.type = type;
+				node.value = elem;
+			} else if (type == 'X') {
+				node.var = elem.get_var_type();
+				if (node.var == 'I') node.type = 'Z';
+				else if (node.var == 'N') node.type = 'S';
+				else throw std::runtime_error("Unknown variable type in RPN !");
+			} else {
+				throw std::runtime_error("Illegal data type in preprocessed RPN !");
+			}
+
+			return node;
+		}
+
+		// Node for operator elem applied to nodes lhs (l) and rhs (r); type checked and folded.
+		static ExprNode make_op(const Element& elem, uint32_t lhs, const ExprNode& l, uint32_t rhs, const ExprNode& r) {
+			ExprNode node;
+			node.type = Int64Opt::result_type(elem.get_opt_type(), l.type, r.type);
+			if (node.type == 0) {
+				std::stringstream ss;
+				ss << "Illegal operator type \"" << Int64Opt::opt_name(elem.get_opt_type()) << "\" !";
+				throw std::runtime_error(ss.str());
+			}
+
+			if (l.is_const() && r.is_const()) {
+				node.value = Int64Opt::do_opt(elem, l.value, r.value);
+			} else {
+				node.op = elem.get_opt_type();
+				node.lhs = lhs;
+				node.rhs = rhs;
+			}
+
+			return node;
+		}
+
+		static void check_root_type(int64_t root_type) {
+			if (root_type != 'Z' && root_type != 'S') throw std::runtime_error("Illegal data type in preprocessed RPN !");
+		}
+
+		static ExprTree build(const std::vector<Element>& rpn) {
+			ExprTree tree;
+			tree.nodes.reserve(rpn.size());
+
+			std::vector<uint32_t> stk;
+			for (auto& elem : rpn) {
+				ExprNode node;
+
+				if (elem.get_type() == '#') {
+					if (stk.size() < 2) throw std::runtime_error("Illegal expression !");
+					uint32_t rhs = stk.back();
+					stk.pop_back();
+					uint32_t lhs = stk.back();
+					stk.pop_back();
+					node = make_op(elem, lhs, tree.nodes[lhs], rhs, tree.nodes[rhs]);
+				} else {
+					node = make_leaf(elem);
+				}
+
+				stk.push_back(static_cast<uint32_t>(tree.nodes.size()));
+				tree.nodes.emplace_back(std::move(node));
+			}
+
+			if (stk.size() != 1) throw std::runtime_error("Illegal expression !");
+			tree.root = stk.back();
+			check_root_type(tree.nodes[tree.root].type);
+
+			return tree;
+		}
+	};
+
+	enum class OpCode : uint8_t {
+		PUSH_INT,		// arg = value
+		PUSH_STR,		// arg = offset into pool, len = length
+		LOAD_INDEX,
+		LOAD_OFNAME,
+		ADD,			// Z + Z
+		SUB,			// Z - Z
+		MUL,			// Z * Z
+		DIV,			// Z / Z
+		CONCAT,			// S + ... + S over the top len strings
+		FMT,			// Z * F, arg = minimum length
+		LOAD_AFFINE,	// arg = index into affine()
+		FMT_AFFINE,		// formatted LOAD_AFFINE, arg = index into affine()
+	};
+
+	struct Instr {
+		OpCode op;
+		uint32_t len;
+		int64_t arg;
+	};
+
+	// Variables an expression can reference. Program records how often each one is used,
+	// so callers only bind (or fetch the metadata behind) the variables a job needs.
+	enum class VarSlot : uint8_t {
+		INDEX,			// 'I'
+		OFNAME,			// 'N'
+	};
+
+	inline constexpr size_t VAR_SLOTS = 2;
+
+	constexpr VarSlot var_slot(int64_t var_type) noexcept {
+		return (var_type == 'I') ? VarSlot::INDEX : VarSlot::OFNAME;
+	}
+
+	// scale * INDEX + offset; min_len is only used by FMT_AFFINE.
+	struct Affine {
+		int64_t scale;
+		int64_t offset;
+		int64_t min_len;
+	};
+
+	class Program {
+	private:
+		friend Program compile(const ExprTree& tree);
+
+		std::vector<Instr> code_;
+		std::wstring pool_;
+		std::vector<Affine> affine_;
+		std::array<uint32_t, VAR_SLOTS> var_uses_{};
+		size_t max_depth_ = 0;
+
+		void emit_const(const Element& value) {
+			if (value.get_type() == 'Z') {
+				code_.push_back({ OpCode::PUSH_INT, 0, value.get_val() });
+			} else {
+				std::wstring_view s = value.str_view();
+				code_.push_back({ OpCode::PUSH_STR, static_cast<uint32_t>(s.size()), static_cast<int64_t>(pool_.size()) });
+				pool_ += s;
+			}
+		}
+
+		// Counts the variable leaves reachable from id. Folded subtrees are unreachable and
+		// never contain variables, so they do not count.
+		void count_vars(const ExprTree& tree, uint32_t id) {
+			const ExprNode& node = tree[id];
+			if (node.op != 0) {
+				count_vars(tree, node.lhs);
+				count_vars(tree, node.rhs);
+			} else if (node.var != 0) {
+				++var_uses_[static_cast<size_t>(var_slot(node.var))];
+			}
+		}
+
+		// Wrapping arithmetic in uint64_t, like int64_add() and friends behind the operators,
+		// so the affine form agrees with step by step evaluation even when intermediate
+		// values overflow.
+		static bool as_affine(const ExprTree& tree, uint32_t id, uint64_t& scale, uint64_t& offset) {
+			const ExprNode& node = tree[id];
+			if (node.type != 'Z') return false;
+
+			if (node.op == 0) {
+				if (node.var == 'I') { scale = 1; offset = 0; return true; }
+				if (node.var != 0) return false;
+				scale = 0;
+				offset = static_cast<uint64_t>(node.value.get_val());
+				return true;
+			}
+
+			uint64_t ls, lo, rs, ro;
+			if (node.op == '/') return false;
+			if (!as_affine(tree, node.lhs, ls, lo) || !as_affine(tree, node.rhs, rs, ro)) return false;
+
+			switch (node.op) {
+				case '+': scale = ls + rs; offset = lo + ro; return true;
+				case '-': scale = ls - rs; offset = lo - ro; return true;
+				case '*':
+					if (ls != 0 && rs != 0) return false;	// INDEX * INDEX
+					scale = ls * ro + rs * lo;
+					offset = lo * ro;
+					return true;
+				default: return false;
+			}
+		}
+
+		// Pushes the text of numeric subtree id, padded to min_len digits.
+		size_t emit_formatted(const ExprTree& tree, uint32_t id, int64_t min_len) {
+			uint64_t scale, offset;
+			if (as_affine(tree, id, scale, offset) && scale != 0) {
+				code_.push_back({ OpCode::FMT_AFFINE, 0, static_cast<int64_t>(affine_.size()) });
+				affine_.push_back({ static_cast<int64_t>(scale), static_cast<int64_t>(offset), min_len });
+				return 1;
+			}
+
+			size_t depth = emit(tree, id);
+			code_.push_back({ OpCode::FMT, 0, min_len });
+			return depth;
+		}
+
+		// Operands of a chain of string '+', left to right. Number operands are
+		// formatted in place (FMT 0) before the chain is joined.
+		static void collect_concat(const ExprTree& tree, uint32_t id, std::vector<uint32_t>& pieces) {
+			const ExprNode& node = tree[id];
+			if (node.op == '+' && node.type == 'S') {
+				collect_concat(tree, node.lhs, pieces);
+				collect_concat(tree, node.rhs, pieces);
+			} else {
+				pieces.push_back(id);
+			}
+		}
+
+		size_t emit_concat(const ExprTree& tree, uint32_t id) {
+			std::vector<uint32_t> pieces;
+			collect_concat(tree, id, pieces);
+
+			size_t depth = 0;
+			uint32_t count = 0;
+			std::wstring text;
+			for (size_t i = 0; i < pieces.size(); ++i) {
+				const ExprNode& piece = tree[pieces[i]];
+
+				// Merge runs of constant pieces into one pooled string.
+				if (piece.is_const()) {
+					text += piece.value.get_str();
+					if (i + 1 < pieces.size() && tree[pieces[i + 1]].is_const()) continue;
+					emit_const(Str(text));
+					text.clear();
+					depth = (std::max)(depth, count + size_t{ 1 });
+				} else if (piece.type == 'Z') {
+					depth = (std::max)(depth, count + emit_formatted(tree, pieces[i], 0));
+				} else {
+					depth = (std::max)(depth, count + emit(tree, pieces[i]));
+				}
+				++count;
+			}
+
+			if (count > 1) code_.push_back({ OpCode::CONCAT, count, 0 });
+			return depth;
+		}
+
+		// Post-order emission; returns the stack depth needed by the subtree.
+		size_t emit(const ExprTree& tree, uint32_t id) {
+			const ExprNode& node = tree[id];
+
+			if (node.op == 0) {
+				if (node.var == 'I') code_.push_back({ OpCode::LOAD_INDEX, 0, 0 });
+				else if (node.var == 'N') code_.push_back({ OpCode::LOAD_OFNAME, 0, 0 });
+				else emit_const(node.value);
+				return 1;
+			}
+
+			const ExprNode& l = tree[node.lhs];
+			const ExprNode& r = tree[node.rhs];
+
+			if (node.op == '+' && node.type == 'S') return emit_concat(tree, id);
+
+			// The format operand is always a constant, so it becomes an immediate.
+			if (node.op == '*' && node.type == 'S') {
+				bool num_left = (l.type == 'Z');
+				return emit_formatted(tree, num_left ? node.lhs : node.rhs, (num_left ? r : l).value.get_min_length());
+			}
+
+			uint64_t scale, offset;
+			if (as_affine(tree, id, scale, offset)) {
+				code_.push_back({ OpCode::LOAD_AFFINE, 0, static_cast<int64_t>(affine_.size()) });
+				affine_.push_back({ static_cast<int64_t>(scale), static_cast<int64_t>(offset), 0 });
+				return 1;
+			}
+
+			size_t ldepth = emit(tree, node.lhs);
+			size_t rdepth = emit(tree, node.rhs) + 1;
+
+			OpCode op = OpCode::ADD;
+			if (node.op == '-') op = OpCode::SUB;
+			else if (node.op == '*') op = OpCode::MUL;
+			else if (node.op == '/') op = OpCode::DIV;
+			code_.push_back({ op, 0, 0 });
+
+			return (ldepth > rdepth) ? ldepth : rdepth;
+		}
+
+	public:
+		const std::vector<Instr>& code() const { return code_; }
+		const std::wstring& pool() const { return pool_; }
+		const std::vector<Affine>& affine() const { return affine_; }
+		size_t max_depth() const { return max_depth_; }
+		bool empty() const { return code_.empty(); }
+
+		uint32_t var_uses(VarSlot v) const { return var_uses_[static_cast<size_t>(v)]; }
+		bool uses(VarSlot v) const { return var_uses(v) != 0; }
+	};
+
+	inline Program compile(const ExprTree& tree) {
+		Program prog;
+		prog.code_.reserve(tree.nodes.size());
+		prog.count_vars(tree, tree.root);
+		prog.max_depth_ = (tree[tree.root].type == 'Z') ? prog.emit_formatted(tree, tree.root, 0) : prog.emit(tree, tree.root);
+		return prog;
+	}
+
+	inline Program compile(const std::vector<Element>& rpn) {
+		return compile(ExprTree::build(rpn));
+	}
+
+} // namespace calc
+
+#endif // !_CALC_PROGRAM_HPP
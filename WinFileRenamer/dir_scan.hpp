@@ -0,0 +1,277 @@
+﻿#ifndef _DIR_SCAN_HPP
+#define _DIR_SCAN_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <filesystem>
+#endif
+
+#include "fs_path.hpp"
+#include "platform_fs.hpp"
+#include "work_pool.hpp"
+
+namespace pt {
+
+#ifdef _WIN32
+inline constexpr wchar_t PATH_SEPARATOR = L'\\';
+#else
+inline constexpr wchar_t PATH_SEPARATOR = L'/';
+#endif
+
+namespace detail {
+
+inline wchar_t glob_fold(wchar_t c, bool fold_case) {
+	return fold_case ? static_cast<wchar_t>(std::towupper(c)) : c;
+}
+
+// Matches c against the set that starts with '[' at pattern[at], and sets next past its ']'.
+// Returns 1 or 0, or -1 when the set is not closed and the '[' is an ordinary character.
+inline int glob_set(std::wstring_view pattern, size_t at, wchar_t c, bool fold_case, size_t& next) {
+	size_t i = at + 1;
+	bool negate = false;
+	if (i < pattern.size() && (pattern[i] == L'!' || pattern[i] == L'^')) {
+		negate = true;
+		++i;
+	}
+
+	const wchar_t fc = glob_fold(c, fold_case);
+	bool hit = false;
+	for (bool first = true; i < pattern.size() && (first || pattern[i] != L']'); first = false) {
+		wchar_t lo = pattern[i];
+		wchar_t hi = lo;
+		if (i + 2 < pattern.size() && pattern[i + 1] == L'-' && pattern[i + 2] != L']') {
+			hi = pattern[i + 2];
+			i += 3;
+		} else {
+			++i;
+		}
+		hit = hit || (lo <= c && c <= hi) || (glob_fold(lo, fold_case) <= fc && fc <= glob_fold(hi, fold_case));
+	}
+	if (i >= pattern.size()) return -1;
+
+	next = i + 1;
+	return hit != negate;
+}
+
+} // namespace detail
+
+// Shell-style match of a whole file name: '*' is any run of characters, '?' any one, and
+// [abc], [a-z] or [!abc] one character of (or not of) a set.
+inline bool GlobMatch(std::wstring_view pattern, std::wstring_view name, bool fold_case) {
+	constexpr size_t NONE = static_cast<size_t>(-1);
+	size_t p = 0;
+	size_t n = 0;
+	size_t star_p = NONE;		// pattern position after the last '*', and the name
+	size_t star_n = 0;			// position that '*' is currently stretched to
+
+	while (n < name.size()) {
+		bool step = false;
+		if (p < pattern.size()) {
+			wchar_t pc = pattern[p];
+			if (pc == L'*') {
+				star_p = ++p;
+				star_n = n;
+				continue;
+			}
+
+			size_t next = p + 1;
+			int set = (pc == L'[') ? detail::glob_set(pattern, p, name[n], fold_case, next) : -1;
+			if (set >= 0) step = (set == 1);
+			else step = (pc == L'?') || detail::glob_fold(pc, fold_case) == detail::glob_fold(name[n], fold_case);
+
+			if (step) {
+				p = next;
+				++n;
+			}
+		}
+		if (!step) {
+			if (star_p == NONE) return false;
+			p = star_p;
+			n = ++star_n;
+		}
+	}
+
+	while (p < pattern.size() && pattern[p] == L'*') ++p;
+	return p == pattern.size();
+}
+
+struct ScanOptions {
+	size_t max_depth = SIZE_MAX;			// directory levels to enter below a root; 0 reads the root only
+	std::vector<std::wstring> include;		// file name globs, one of which must match; none takes every file
+	std::vector<std::wstring> exclude;		// file and directory name globs; excluded directories are not entered
+	bool fold_case = DEFAULT_FOLD_CASE;		// for the globs
+	size_t concurrency = 0;					// directories read at once; 0 is one per hardware thread
+};
+
+struct ScanStats {
+	size_t dirs = 0;
+	size_t files = 0;
+	size_t errors = 0;		// directories that could not be read, or only partly
+};
+
+// The files found in one directory: dir ends with a separator, names are sorted.
+struct ScanBatch {
+	std::wstring dir;
+	std::vector<std::wstring> names;
+};
+
+namespace detail {
+
+// Calls fn(name, is_dir) for every entry of dir ("" is the current directory) except
+// "." and "..". Symbolic links, junctions and other reparse points count as files: the
+// scanner lists them but never follows them. Returns false when dir could not be read.
+#if defined(_WIN32)
+template <typename Fn>
+inline bool read_directory(const std::wstring& dir, Fn&& fn) {
+	std::wstring pattern = dir.empty() ? std::wstring(L"*") : MakeLongPath(dir) + L"*";
+
+	WIN32_FIND_DATAW data;
+	HANDLE h = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (h == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+
+	do {
+		const wchar_t* name = data.cFileName;
+		if (name[0] == L'.' && (name[1] == L'\0' || (name[1] == L'.' && name[2] == L'\0'))) continue;
+		DWORD attrs = data.dwFileAttributes;
+		fn(std::wstring(name), (attrs & FILE_ATTRIBUTE_DIRECTORY) && !(attrs & FILE_ATTRIBUTE_REPARSE_POINT));
+	} while (FindNextFileW(h, &data));
+
+	bool ok = (GetLastError() == ERROR_NO_MORE_FILES);
+	FindClose(h);
+	return ok;
+}
+#elif defined(__linux__)
+// Reads raw getdents64 records in large blocks, and only stats the entries whose type
+// the file system did not report.
+template <typename Fn>
+inline bool read_directory(const std::wstring& dir, Fn&& fn) {
+	std::string path = dir.empty() ? std::string(".") : WideToUtf8(dir);
+	int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) return false;
+
+	alignas(8) char buf[32768];
+	bool ok = true;
+	while (true) {
+		long got = ::syscall(SYS_getdents64, fd, buf, sizeof(buf));
+		if (got == 0) break;
+		if (got < 0) {
+			if (errno == EINTR) continue;
+			ok = false;
+			break;
+		}
+
+		// struct linux_dirent64: d_ino (8 bytes), d_off (8), d_reclen (2), d_type (1), d_name
+		for (long off = 0; off < got;) {
+			uint16_t reclen;
+			std::memcpy(&reclen, buf + off + 16, sizeof(reclen));
+			unsigned char type = static_cast<unsigned char>(buf[off + 18]);
+			const char* name = buf + off + 19;
+			off += reclen;
+
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+			if (type == DT_UNKNOWN) {
+				struct stat st;
+				if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+				type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+			}
+			fn(Utf8ToWide(name), type == DT_DIR);
+		}
+	}
+
+	::close(fd);
+	return ok;
+}
+#else
+template <typename Fn>
+inline bool read_directory(const std::wstring& dir, Fn&& fn) {
+	std::error_code ec;
+	std::filesystem::directory_iterator it(dir.empty() ? std::filesystem::path(".") : ToFsPath(dir), ec);
+	for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+		std::error_code type_ec;
+		bool is_dir = it->symlink_status(type_ec).type() == std::filesystem::file_type::directory;
+		fn(FromFsPath(it->path().filename()), is_dir);
+	}
+	return !ec;
+}
+#endif
+
+} // namespace detail
+
+// Walks the tree under root in parallel: every directory is a task on a work-stealing
+// pool, and the subdirectories it finds become tasks in turn. The filters apply during the
+// walk, so excluded subtrees and directories below max_depth are never read.
+//
+// sink(ScanBatch&&) gets the matching files of each directory that has any, in no
+// particular order, and from several workers at once.
+template <typename Sink>
+inline ScanStats ScanDirectoryStream(std::wstring_view root, const ScanOptions& opts, Sink&& sink) {
+	std::wstring top(root);
+	if (!top.empty() && top.back() != PATH_SEPARATOR && top.back() != L'/') top.push_back(PATH_SEPARATOR);
+
+	auto matches_any = [&](const std::vector<std::wstring>& globs, std::wstring_view name) {
+		for (const auto& g : globs) {
+			if (GlobMatch(g, name, opts.fold_case)) return true;
+		}
+		return false;
+	};
+
+	std::atomic<size_t> dirs{ 0 };
+	std::atomic<size_t> files{ 0 };
+	std::atomic<size_t> errors{ 0 };
+
+	aop::WorkStealingPool pool(opts.concurrency);
+	std::function<void(std::wstring, size_t)> visit = [&](std::wstring dir, size_t depth) {
+		ScanBatch batch;
+		bool ok = detail::read_directory(dir, [&](std::wstring&& name, bool is_dir) {
+			if (matches_any(opts.exclude, name)) return;
+			if (is_dir) {
+				if (depth < opts.max_depth) {
+					pool.submit([&visit, sub = dir + name + PATH_SEPARATOR, depth]() mutable { visit(std::move(sub), depth + 1); });
+				}
+			} else if (opts.include.empty() || matches_any(opts.include, name)) {
+				batch.names.push_back(std::move(name));
+			}
+		});
+
+		dirs.fetch_add(1, std::memory_order_relaxed);
+		if (!ok) errors.fetch_add(1, std::memory_order_relaxed);
+		if (batch.names.empty()) return;
+
+		files.fetch_add(batch.names.size(), std::memory_order_relaxed);
+		std::sort(batch.names.begin(), batch.names.end());
+		batch.dir = std::move(dir);
+		sink(std::move(batch));
+	};
+
+	pool.submit([&] { visit(std::move(top), 0); });
+	pool.wait();
+
+	return { dirs.load(), files.load(), errors.load() };
+}
+
+} // namespace pt
+
+#endif // !_DIR_SCAN_HPP
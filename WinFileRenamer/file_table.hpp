@@ -0,0 +1,251 @@
+﻿#ifndef _FILE_TABLE_HPP
+#define _FILE_TABLE_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "fs_path.hpp"
+
+namespace pt {
+
+// The selected files as a compact table. Every distinct directory is stored once, the
+// file names are packed into one character arena, and a file is only its directory id
+// plus the place of its name in the arena, instead of a full path string each.
+//
+// An open-addressing index over the entries finds a path already in the table in O(1),
+// so push() refuses duplicates without comparing against every file. All members are
+// plain values, so a copy (as CowBox makes one) is a complete, independent table.
+class FileTable {
+public:
+	struct Entry {
+		uint32_t dir;
+		uint32_t len;
+		uint64_t off;		// into the name arena
+	};
+
+private:
+	static constexpr uint32_t EMPTY = 0;	// slots hold entry index + 1
+	static constexpr uint32_t NO_DIR = static_cast<uint32_t>(-1);
+
+	struct DirHash {
+		using is_transparent = void;
+		size_t operator()(std::wstring_view s) const { return std::hash<std::wstring_view>{}(s); }
+	};
+
+	std::vector<std::wstring> dirs_;	// with the trailing separator; "" for a bare name
+	std::unordered_map<std::wstring, uint32_t, DirHash, std::equal_to<>> dir_ids_;
+	uint32_t last_dir_ = 0;			// files mostly arrive directory by directory
+	std::string last_utf8_dir_;		// the same for push_utf8, before decoding
+	uint32_t last_utf8_dir_id_ = NO_DIR;	// NO_DIR until push_utf8 has looked one up
+	std::wstring names_;
+	std::vector<Entry> entries_;
+	std::vector<uint32_t> hashes_;		// per entry, to skip most mismatches and to rehash
+	std::vector<uint32_t> slots_;		// power of two, at most half full
+
+	static uint32_t hash_of(uint32_t dir, std::wstring_view name) {
+		uint64_t h = std::hash<std::wstring_view>{}(name) ^ (0x9E3779B97F4A7C15ull * (dir + 1));
+		h ^= h >> 29;
+		return static_cast<uint32_t>(h ^ (h >> 32));
+	}
+
+	void rehash(size_t count) {
+		std::vector<uint32_t> slots(count, EMPTY);
+		const size_t mask = slots.size() - 1;
+		for (uint32_t e = 0; e < entries_.size(); ++e) {
+			size_t s = hashes_[e] & mask;
+			while (slots[s] != EMPTY) s = (s + 1) & mask;
+			slots[s] = e + 1;
+		}
+		slots_.swap(slots);
+	}
+
+	uint32_t intern_dir(std::wstring_view dir) {
+		if (last_dir_ < dirs_.size() && dirs_[last_dir_] == dir) return last_dir_;
+
+		auto it = dir_ids_.find(dir);
+		if (it == dir_ids_.end()) {
+			it = dir_ids_.emplace(std::wstring(dir), static_cast<uint32_t>(dirs_.size())).first;
+			dirs_.emplace_back(dir);
+		}
+		return last_dir_ = it->second;
+	}
+
+	// Adds the entry whose name is already at the end of the arena, from off; drops that
+	// name again when the table holds it.
+	bool add(uint32_t d, size_t off) {
+		std::wstring_view leaf = std::wstring_view(names_).substr(off);
+		uint32_t h = hash_of(d, leaf);
+
+		if (2 * (entries_.size() + 1) > slots_.size()) rehash(slots_.empty() ? 16 : slots_.size() * 2);
+		const size_t mask = slots_.size() - 1;
+		size_t s = h & mask;
+		for (; slots_[s] != EMPTY; s = (s + 1) & mask) {
+			uint32_t e = slots_[s] - 1;
+			if (hashes_[e] == h && entries_[e].dir == d && name(e) == leaf) {
+				names_.resize(off);
+				return false;
+			}
+		}
+
+		slots_[s] = static_cast<uint32_t>(entries_.size() + 1);
+		entries_.push_back({ d, static_cast<uint32_t>(leaf.size()), off });
+		hashes_.push_back(h);
+		return true;
+	}
+
+public:
+	size_t size() const { return entries_.size(); }
+	bool empty() const { return entries_.empty(); }
+
+	size_t name_chars() const { return names_.size(); }
+
+	size_t dir_count() const { return dirs_.size(); }
+	const std::wstring& dir_name(uint32_t d) const { return dirs_[d]; }
+
+	uint32_t dir_id(size_t i) const { return entries_[i].dir; }
+	const std::wstring& dir(size_t i) const { return dirs_[entries_[i].dir]; }
+	std::wstring_view name(size_t i) const { return std::wstring_view(names_).substr(entries_[i].off, entries_[i].len); }
+
+	std::wstring path(size_t i) const {
+		const std::wstring& d = dir(i);
+		std::wstring_view n = name(i);
+		std::wstring out;
+		out.reserve(d.size() + n.size());
+		out.append(d).append(n);
+		return out;
+	}
+
+	// Adds path unless the table already holds it; returns whether it was added.
+	bool push(std::wstring_view path) {
+		std::wstring_view leaf = FileNameView(path);
+		return push(path.substr(0, path.size() - leaf.size()), leaf);
+	}
+
+	// As push(path) for the path dir + leaf, where dir is empty or ends with a separator.
+	bool push(std::wstring_view dir, std::wstring_view leaf) {
+		uint32_t d = intern_dir(dir);
+		size_t off = names_.size();
+		names_.append(leaf);
+		return add(d, off);
+	}
+
+	// As push(dir, leaf) for every name of one directory; returns how many were added.
+	size_t push(std::wstring_view dir, const std::vector<std::wstring>& leaves) {
+		uint32_t d = intern_dir(dir);
+		size_t added = 0;
+		for (const auto& leaf : leaves) {
+			size_t off = names_.size();
+			names_.append(leaf);
+			added += add(d, off);
+		}
+		return added;
+	}
+
+	// Orders the entries from first on by directory, keeping their order within each
+	// directory: a load that arrives directory by directory, in no particular order,
+	// then reads as if it had been added sorted.
+	void sort_by_dir(size_t first) {
+		if (entries_.size() - first < 2) return;
+
+		// Rank the directories once, so the sort compares integers.
+		std::vector<uint32_t> used;
+		std::vector<uint32_t> rank(dirs_.size(), 0);
+		for (size_t e = first; e < entries_.size(); ++e) {
+			uint32_t d = entries_[e].dir;
+			if (rank[d] == 0) {
+				rank[d] = 1;
+				used.push_back(d);
+			}
+		}
+		std::sort(used.begin(), used.end(), [&](uint32_t a, uint32_t b) { return dirs_[a] < dirs_[b]; });
+		for (uint32_t r = 0; r < used.size(); ++r) rank[used[r]] = r;
+
+		std::vector<uint32_t> order(entries_.size() - first);
+		std::iota(order.begin(), order.end(), static_cast<uint32_t>(first));
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return rank[entries_[a].dir] < rank[entries_[b].dir]; });
+
+		std::vector<Entry> entries(order.size());
+		std::vector<uint32_t> hashes(order.size());
+		for (size_t k = 0; k < order.size(); ++k) {
+			entries[k] = entries_[order[k]];
+			hashes[k] = hashes_[order[k]];
+		}
+		std::copy(entries.begin(), entries.end(), entries_.begin() + first);
+		std::copy(hashes.begin(), hashes.end(), hashes_.begin() + first);
+		rehash(slots_.size());
+	}
+
+	// Drops the entries from count on, as if they had never been added.
+	void truncate(size_t count) {
+		if (count >= entries_.size()) return;
+
+		size_t chars = names_.size();
+		for (size_t e = count; e < entries_.size(); ++e) chars = (std::min)(chars, static_cast<size_t>(entries_[e].off));
+		entries_.resize(count);
+		hashes_.resize(count);
+		names_.resize(chars);
+		rehash(slots_.size());
+	}
+
+	// The directory part of a UTF-8 path, with its trailing separator, as FileNameView splits.
+	static std::string_view utf8_dir(std::string_view path) {
+#ifdef _WIN32
+		size_t cut = path.find_last_of("\\/");
+		if (cut == std::string_view::npos && path.size() >= 2 && path[1] == ':') cut = 1;
+#else
+		size_t cut = path.find_last_of('/');
+#endif
+		return (cut == std::string_view::npos) ? std::string_view() : path.substr(0, cut + 1);
+	}
+
+	// As push(path) for a UTF-8 path. The name is decoded straight into the arena, and a
+	// run of paths in one directory decodes and looks up that directory only once.
+	bool push_utf8(std::string_view path) {
+		std::string_view dir = utf8_dir(path);
+		if (last_utf8_dir_id_ == NO_DIR || dir != last_utf8_dir_) {
+			last_utf8_dir_id_ = intern_dir(Utf8ToWide(dir));
+			last_utf8_dir_.assign(dir);
+		}
+
+		size_t off = names_.size();
+		AppendUtf8ToWide(path.substr(dir.size()), names_);
+		return add(last_utf8_dir_id_, off);
+	}
+
+	// Makes room for files entries in total whose names add up to name_chars, so a bulk
+	// load neither reallocates nor rehashes on the way.
+	void reserve(size_t files, size_t name_chars = 0) {
+		entries_.reserve(files);
+		hashes_.reserve(files);
+		names_.reserve(name_chars);
+
+		size_t count = slots_.empty() ? 16 : slots_.size();
+		while (2 * files > count) count *= 2;
+		if (count != slots_.size()) rehash(count);
+	}
+
+	void clear() {
+		dirs_.clear();
+		dir_ids_.clear();
+		last_dir_ = 0;
+		last_utf8_dir_.clear();
+		last_utf8_dir_id_ = NO_DIR;
+		names_.clear();
+		entries_.clear();
+		hashes_.clear();
+		slots_.clear();
+	}
+};
+
+} // namespace pt
+
+#endif // !_FILE_TABLE_HPP
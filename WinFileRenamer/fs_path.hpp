@@ -0,0 +1,153 @@
+﻿#ifndef _FS_PATH_HPP
+#define _FS_PATH_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace pt {
+
+inline static std::wstring MakeLongPath(const std::wstring& path) {
+	// If already in long path format, return as is
+	if (path.rfind(L"\\\\?\\", 0) == 0) {
+		return path;
+	}
+	// Handle UNC paths
+	if (path.size() >= 2 && path[0] == L'\\' && path[1] == L'\\') {
+		// \\server\share\xxx  ->  \\?\UNC\server\share\xxx
+		return L"\\\\?\\UNC\\" + path.substr(2);
+	}
+	// Handle drive letter paths
+	if (path.size() >= 2 && path[1] == L':') {
+		return L"\\\\?\\" + path;
+	}
+	// For other paths, return as is (could be relative paths)
+	return path;
+}
+
+// Last component of a path, as std::filesystem::path::filename() would return it,
+// without building a path object.
+inline static std::wstring_view FileNameView(std::wstring_view path) {
+#ifdef _WIN32
+	size_t pos = path.find_last_of(L"\\/");
+	if (pos == std::wstring_view::npos && path.size() >= 2 && path[1] == L':') pos = 1;
+#else
+	size_t pos = path.find_last_of(L'/');
+#endif
+	return (pos == std::wstring_view::npos) ? path : path.substr(pos + 1);
+}
+
+// UTF-8 <-> wide text. wchar_t holds UTF-16 on Windows and UTF-32 elsewhere; invalid
+// input becomes U+FFFD.
+//
+// Decodes s onto the end of out. A wide string never has more characters than its UTF-8
+// form has bytes, so room is made once and the characters are written in place.
+inline void AppendUtf8ToWide(std::string_view s, std::wstring& out) {
+	const size_t base = out.size();
+	out.resize(base + s.size());
+	wchar_t* dst = out.data() + base;
+
+	static constexpr uint32_t min_cp[] = { 0, 0x80, 0x800, 0x10000 };
+
+	size_t i = 0;
+	while (i < s.size()) {
+		uint32_t c = static_cast<unsigned char>(s[i]);
+		if (c < 0x80) {
+			*dst++ = static_cast<wchar_t>(c);
+			++i;
+			continue;
+		}
+
+		size_t n = ((c & 0xE0) == 0xC0) ? 1 : ((c & 0xF0) == 0xE0) ? 2 : ((c & 0xF8) == 0xF0) ? 3 : 4;
+		uint32_t cp = 0xFFFD;
+		size_t used = 1;
+
+		if (n < 4 && i + n < s.size()) {
+			uint32_t v = c & (0x3F >> n);
+			size_t k = 1;
+			for (; k <= n && (static_cast<unsigned char>(s[i + k]) & 0xC0) == 0x80; ++k) {
+				v = (v << 6) | (static_cast<unsigned char>(s[i + k]) & 0x3F);
+			}
+			if (k > n && v >= min_cp[n] && v <= 0x10FFFF && (v < 0xD800 || v > 0xDFFF)) {
+				cp = v;
+				used = n + 1;
+			}
+		}
+		i += used;
+
+		if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+			cp -= 0x10000;
+			*dst++ = static_cast<wchar_t>(0xD800 + (cp >> 10));
+			*dst++ = static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+		} else {
+			*dst++ = static_cast<wchar_t>(cp);
+		}
+	}
+
+	out.resize(static_cast<size_t>(dst - out.data()));
+}
+
+inline std::wstring Utf8ToWide(std::string_view s) {
+	std::wstring out;
+	AppendUtf8ToWide(s, out);
+	return out;
+}
+
+inline std::string WideToUtf8(std::wstring_view w) {
+	std::string out;
+	out.reserve(w.size());
+
+	for (size_t i = 0; i < w.size(); ++i) {
+		uint32_t cp = static_cast<uint32_t>(w[i]);
+		if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp <= 0xDBFF && i + 1 < w.size()) {
+			uint32_t lo = static_cast<uint32_t>(w[i + 1]);
+			if (lo >= 0xDC00 && lo <= 0xDFFF) {
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+				++i;
+			}
+		}
+		if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) cp = 0xFFFD;
+
+		if (cp < 0x80) {
+			out.push_back(static_cast<char>(cp));
+		} else if (cp < 0x800) {
+			out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+		} else if (cp < 0x10000) {
+			out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+		} else {
+			out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+		}
+	}
+
+	return out;
+}
+
+// std::filesystem::path for a wide path and back. libstdc++ converts wchar_t paths with
+// the "C" locale, which rejects any non-ASCII name, so non-Windows builds go through
+// UTF-8 explicitly.
+inline std::filesystem::path ToFsPath(const std::wstring& path) {
+#ifdef _WIN32
+	return std::filesystem::path(path);
+#else
+	return std::filesystem::path(WideToUtf8(path));
+#endif
+}
+
+inline std::wstring FromFsPath(const std::filesystem::path& path) {
+#ifdef _WIN32
+	return path.wstring();
+#else
+	return Utf8ToWide(path.native());
+#endif
+}
+
+} // namespace pt
+
+#endif // !_FS_PATH_HPP
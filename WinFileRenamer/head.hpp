@@ -5,6 +5,19 @@
 
 #include "aop.hpp"
 #include "calc.hpp"
+#include "calc_program.hpp"
+#include "calc_batch.hpp"
+#include "calc_incremental.hpp"
+#include "calc_parser.hpp"
+#include "work_pool.hpp"
+#include "bounded_queue.hpp"
+#include "fs_path.hpp"
+#include "platform_fs.hpp"
+#include "uring.hpp"
+#include "file_table.hpp"
+#include "dir_scan.hpp"
+#include "manifest.hpp"
+#include "rename_plan.hpp"
 #include "process_thread.hpp"
 
 
@@ -0,0 +1,128 @@
+﻿#ifndef _MANIFEST_HPP
+#define _MANIFEST_HPP
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fs_path.hpp"
+
+namespace pt {
+
+// A whole file mapped read-only into memory, for lists too large to read line by line.
+class MappedFile {
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+#ifdef _WIN32
+	HANDLE mapping_ = NULL;
+#endif
+
+	void release() {
+#ifdef _WIN32
+		if (data_) UnmapViewOfFile(data_);
+		if (mapping_) CloseHandle(mapping_);
+		mapping_ = NULL;
+#else
+		if (data_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+public:
+	explicit MappedFile(const std::wstring& path) {
+#ifdef _WIN32
+		HANDLE file = CreateFileW(MakeLongPath(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("File list cannot be opened !");
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size)) {
+			CloseHandle(file);
+			throw std::runtime_error("File list cannot be read !");
+		}
+		size_ = static_cast<size_t>(size.QuadPart);
+
+		// An empty file cannot be mapped; it is just an empty list.
+		if (size_ > 0) {
+			mapping_ = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping_) data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		}
+		CloseHandle(file);
+#else
+		int fd = ::open(WideToUtf8(path).c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) throw std::runtime_error("File list cannot be opened !");
+
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+			::close(fd);
+			throw std::runtime_error("File list cannot be read !");
+		}
+		size_ = static_cast<size_t>(st.st_size);
+
+		if (size_ > 0) {
+			void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				data_ = static_cast<const char*>(p);
+				::madvise(p, size_, MADV_SEQUENTIAL);
+			}
+		}
+		::close(fd);
+#endif
+		if (size_ > 0 && !data_) {
+			release();
+			throw std::runtime_error("File list cannot be mapped !");
+		}
+	}
+
+	~MappedFile() { release(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	std::string_view view() const { return std::string_view(data_ ? data_ : "", size_); }
+};
+
+// Calls fn(entry) for every non-empty entry of a list separated by sep: '\0' as written by
+// find -print0, or '\n', where a '\r' before it is dropped as well. The entries are views
+// into data; a UTF-8 byte order mark at the start is skipped.
+template <typename Fn>
+inline size_t ForEachListEntry(std::string_view data, char sep, Fn&& fn) {
+	if (data.substr(0, 3) == "\xEF\xBB\xBF") data.remove_prefix(3);
+
+	size_t count = 0;
+	const char* p = data.data();
+	const char* end = p + data.size();
+	while (p < end) {
+		const char* next = static_cast<const char*>(std::memchr(p, sep, static_cast<size_t>(end - p)));
+		if (!next) next = end;
+
+		std::string_view entry(p, static_cast<size_t>(next - p));
+		if (sep == '\n' && !entry.empty() && entry.back() == '\r') entry.remove_suffix(1);
+		if (!entry.empty()) {
+			fn(entry);
+			++count;
+		}
+
+		if (next == end) break;
+		p = next + 1;
+	}
+	return count;
+}
+
+} // namespace pt
+
+#endif // !_MANIFEST_HPP
@@ -0,0 +1,260 @@
+﻿#ifndef _PLATFORM_FS_HPP
+#define _PLATFORM_FS_HPP
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "fs_path.hpp"
+
+namespace pt {
+
+enum class FsError : uint8_t {
+	NONE,
+	NOT_FOUND,		// the source, or a directory on either path, is missing
+	EXISTS,			// the target exists
+	UNSUPPORTED,	// no atomic no-replace rename here; use the checked path instead
+	OTHER,
+};
+
+// Names that differ only in case are the same file on Windows file systems.
+#ifdef _WIN32
+inline constexpr bool DEFAULT_FOLD_CASE = true;
+#else
+inline constexpr bool DEFAULT_FOLD_CASE = false;
+#endif
+
+#ifndef _WIN32
+#ifdef __linux__
+inline constexpr unsigned int RENAME_NOREPLACE_FLAG = 1;	// RENAME_NOREPLACE, <linux/fs.h>
+#endif
+
+// errno of a failed rename or stat. With no_replace, the errors of a kernel or file
+// system that lacks the no-replace flag are UNSUPPORTED.
+inline FsError FsErrorFromErrno(int code, bool no_replace, std::string& error) {
+	switch (code) {
+		case ENOENT: return FsError::NOT_FOUND;
+		case EEXIST: return FsError::EXISTS;
+		case EINVAL:
+		case ENOSYS:
+		case EOPNOTSUPP:
+#if defined(ENOTSUP) && ENOTSUP != EOPNOTSUPP
+		case ENOTSUP:
+#endif
+			if (no_replace) return FsError::UNSUPPORTED;
+			break;
+		default:
+			break;
+	}
+	error = std::generic_category().message(code);
+	return FsError::OTHER;
+}
+#endif
+
+// Whether b names the same file as a, as a name differing only in case does on a file
+// system that ignores case: NONE when it does, EXISTS when b is another file, NOT_FOUND
+// when b (or a) does not exist. Links are not followed. error receives the system message
+// for OTHER.
+inline FsError SameFile(const std::wstring& a, const std::wstring& b, std::string& error) {
+#ifdef _WIN32
+	auto open = [](const std::wstring& path) {
+		return CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+	};
+	auto fail = [&](DWORD code) {
+		if (code == ERROR_FILE_NOT_FOUND || code == ERROR_PATH_NOT_FOUND) return FsError::NOT_FOUND;
+		error = std::system_category().message(static_cast<int>(code));
+		return FsError::OTHER;
+	};
+
+	HANDLE hb = open(b);
+	if (hb == INVALID_HANDLE_VALUE) return fail(GetLastError());
+	HANDLE ha = open(a);
+	if (ha == INVALID_HANDLE_VALUE) {
+		DWORD code = GetLastError();
+		CloseHandle(hb);
+		return fail(code);
+	}
+
+	BY_HANDLE_FILE_INFORMATION ia, ib;
+	bool ok = GetFileInformationByHandle(ha, &ia) && GetFileInformationByHandle(hb, &ib);
+	DWORD code = ok ? 0 : GetLastError();
+	CloseHandle(ha);
+	CloseHandle(hb);
+	if (!ok) return fail(code);
+
+	bool same = ia.dwVolumeSerialNumber == ib.dwVolumeSerialNumber && ia.nFileIndexHigh == ib.nFileIndexHigh && ia.nFileIndexLow == ib.nFileIndexLow;
+	return same ? FsError::NONE : FsError::EXISTS;
+#else
+	struct stat sa;
+	struct stat sb;
+	if (::lstat(WideToUtf8(b).c_str(), &sb) != 0) return FsErrorFromErrno(errno, false, error);
+	if (::lstat(WideToUtf8(a).c_str(), &sa) != 0) return FsErrorFromErrno(errno, false, error);
+	return (sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino) ? FsError::NONE : FsError::EXISTS;
+#endif
+}
+
+// Renames src to dst unless dst exists, as one system call: the check and the rename
+// cannot be separated by another process creating dst in between.
+//
+//   Windows  MoveFileExW without MOVEFILE_REPLACE_EXISTING
+//   Linux    renameat2(RENAME_NOREPLACE); file systems without it report UNSUPPORTED
+//   macOS    renamex_np(RENAME_EXCL)
+//
+// Other systems always report UNSUPPORTED. error receives the system message for OTHER.
+inline FsError RenameNoReplace(const std::wstring& src, const std::wstring& dst, std::string& error) {
+#ifdef _WIN32
+	if (MoveFileExW(src.c_str(), dst.c_str(), 0)) return FsError::NONE;
+
+	DWORD code = GetLastError();
+	switch (code) {
+		case ERROR_FILE_NOT_FOUND:
+		case ERROR_PATH_NOT_FOUND:
+			return FsError::NOT_FOUND;
+		case ERROR_ALREADY_EXISTS:
+		case ERROR_FILE_EXISTS:
+			return FsError::EXISTS;
+		default:
+			error = std::system_category().message(static_cast<int>(code));
+			return FsError::OTHER;
+	}
+#elif defined(__linux__) && defined(SYS_renameat2)
+	std::string src_utf8 = WideToUtf8(src);
+	std::string dst_utf8 = WideToUtf8(dst);
+	if (::syscall(SYS_renameat2, AT_FDCWD, src_utf8.c_str(), AT_FDCWD, dst_utf8.c_str(), RENAME_NOREPLACE_FLAG) == 0) return FsError::NONE;
+
+	return FsErrorFromErrno(errno, true, error);
+#elif defined(__APPLE__) && defined(RENAME_EXCL)
+	std::string src_utf8 = WideToUtf8(src);
+	std::string dst_utf8 = WideToUtf8(dst);
+	if (::renamex_np(src_utf8.c_str(), dst_utf8.c_str(), RENAME_EXCL) == 0) return FsError::NONE;
+
+	return FsErrorFromErrno(errno, true, error);
+#else
+	(void)src;
+	(void)dst;
+	(void)error;
+	return FsError::UNSUPPORTED;
+#endif
+}
+
+// An open directory, for renaming and looking up the files in it by their name alone:
+// the kernel resolves the directory's path once, when it is opened, instead of on every
+// call. Windows has no such calls in its API, so there a handle never opens and callers
+// keep passing full paths.
+#ifdef _WIN32
+inline constexpr bool HAS_DIR_HANDLES = false;
+#else
+inline constexpr bool HAS_DIR_HANDLES = true;
+#endif
+
+class DirHandle {
+private:
+	int fd_ = -1;
+
+public:
+	DirHandle() = default;
+
+	// Opens dir ("" is the current directory); valid() tells whether that worked.
+	explicit DirHandle(std::wstring_view dir) {
+#ifndef _WIN32
+		std::string path = dir.empty() ? std::string(".") : WideToUtf8(dir);
+		int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#ifdef O_PATH
+		flags = O_PATH | O_DIRECTORY | O_CLOEXEC;	// enough for the *at calls, and needs no read permission
+#endif
+		fd_ = ::open(path.c_str(), flags);
+#else
+		(void)dir;
+#endif
+	}
+
+	DirHandle(const DirHandle&) = delete;
+	DirHandle& operator=(const DirHandle&) = delete;
+
+	DirHandle(DirHandle&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+	DirHandle& operator=(DirHandle&& other) noexcept {
+		if (this != &other) {
+			close();
+			fd_ = other.fd_;
+			other.fd_ = -1;
+		}
+		return *this;
+	}
+
+	~DirHandle() { close(); }
+
+	void close() {
+#ifndef _WIN32
+		if (fd_ >= 0) ::close(fd_);
+#endif
+		fd_ = -1;
+	}
+
+	bool valid() const { return fd_ >= 0; }
+	int native() const { return fd_; }
+};
+
+// Whether name exists in dir, without following a symbolic link: NONE when it does,
+// NOT_FOUND when it does not.
+inline FsError StatAt(const DirHandle& dir, const std::string& name, std::string& error) {
+#ifndef _WIN32
+	struct stat st;
+	if (::fstatat(dir.native(), name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) return FsError::NONE;
+	return FsErrorFromErrno(errno, false, error);
+#else
+	(void)dir;
+	(void)name;
+	(void)error;
+	return FsError::UNSUPPORTED;
+#endif
+}
+
+// Renames src_name in src_dir to dst_name in dst_dir. With no_replace, as RenameNoReplace;
+// otherwise an existing target is replaced, as std::filesystem::rename does.
+inline FsError RenameAt(const DirHandle& src_dir, const std::string& src_name, const DirHandle& dst_dir, const std::string& dst_name, bool no_replace, std::string& error) {
+#if defined(_WIN32)
+	(void)src_dir;
+	(void)src_name;
+	(void)dst_dir;
+	(void)dst_name;
+	(void)no_replace;
+	(void)error;
+	return FsError::UNSUPPORTED;
+#else
+	int ret = -1;
+	if (!no_replace) {
+		ret = ::renameat(src_dir.native(), src_name.c_str(), dst_dir.native(), dst_name.c_str());
+	} else {
+#if defined(__linux__) && defined(SYS_renameat2)
+		ret = static_cast<int>(::syscall(SYS_renameat2, src_dir.native(), src_name.c_str(), dst_dir.native(), dst_name.c_str(), RENAME_NOREPLACE_FLAG));
+#elif defined(__APPLE__) && defined(RENAME_EXCL)
+		ret = ::renameatx_np(src_dir.native(), src_name.c_str(), dst_dir.native(), dst_name.c_str(), RENAME_EXCL);
+#else
+		return FsError::UNSUPPORTED;
+#endif
+	}
+	if (ret == 0) return FsError::NONE;
+	return FsErrorFromErrno(errno, no_replace, error);
+#endif
+}
+
+} // namespace pt
+
+#endif // !_PLATFORM_FS_HPP
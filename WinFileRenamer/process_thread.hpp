@@ -2,11 +2,25 @@
 #define _PROCESS_THREAD_HPP
 
 #include "aop.hpp"
+#include "bounded_queue.hpp"
 #include "calc.hpp"
+#include "calc_program.hpp"
+#include "calc_batch.hpp"
+#include "calc_incremental.hpp"
+#include "calc_parser.hpp"
+#include "dir_scan.hpp"
+#include "file_table.hpp"
+#include "fs_path.hpp"
+#include "manifest.hpp"
+#include "rename_plan.hpp"
+#include "work_pool.hpp"
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <exception>
 #include <sstream>
@@ -17,70 +31,271 @@
 
 namespace pt {
 
-inline static std::wstring MakeLongPath(const std::wstring& path) {
-	// If already in long path format, return as is
-	if (path.rfind(L"\\\\?\\", 0) == 0) {
-		return path;
-	}
-	// Handle UNC paths
-	if (path.size() >= 2 && path[0] == L'\\' && path[1] == L'\\') {
-		// \\server\share\xxx  ->  \\?\UNC\server\share\xxx
-		return L"\\\\?\\UNC\\" + path.substr(2);
-	}
-	// Handle drive letter paths
-	if (path.size() >= 2 && path[1] == L':') {
-		return L"\\\\?\\" + path;
-	}
-	// For other paths, return as is (could be relative paths)
-	return path;
-}
+// Outcome and phase timings of the last job, for headless front ends and benchmarks.
+struct JobStats {
+	bool ok = false;
+	size_t files = 0;
+	double prepare_ms = 0.0;	// snapshot, compile and evaluate, or classify and sort
+	double rename_ms = 0.0;
+};
+
+// What push_filepath did with a path.
+enum class PushStatus {
+	ADDED,
+	DUPLICATE,		// already selected; left out
+	BUSY			// a job is running; nothing can be added
+};
 
 class ProcessThread {
 public:
 	static constexpr int STATE_READY = 0;
 	static constexpr int STATE_ONGOING = 1;
 
+	struct RenameReport {
+		std::wstring src;
+		std::wstring dst;
+		RenameResult result;
+	};
+
 private:
 	std::atomic<bool> msg_box_;
 
 	std::atomic<int> state_;
 
-	aop::LockBox<std::vector<std::wstring>> vec_filepath_cache;
+	// The selected files; a job pins the current version instead of copying it.
+	aop::CowBox<FileTable> vec_filepath_cache;
 
-	aop::LockBox<std::vector<std::unique_ptr<calc::Element>>> input_expr;
+	aop::LockBox<calc::IncrementalRpn> input_expr;
 
 	aop::LockBox<std::wstring> res_wstr;
 
+	aop::LockBox<JobStats> stats_;
+
+	aop::LockBox<RenameOptions> rename_opts_;
+
+	RenameProgress progress_;
+
+	// Renames of the last expression job that failed or were refused, in plan order.
+	aop::LockBox<std::vector<RenameReport>> failed_renames_;
+
+	static void collect_failures(const RenamePlan& plan, const std::vector<RenameResult>& results, std::vector<RenameReport>& out) {
+		for (size_t i = 0; i < results.size(); ++i) {
+			RenameStatus status = results[i].status;
+			if (status == RenameStatus::DONE || status == RenameStatus::PENDING) continue;
+			out.push_back({ plan.src(i), plan.dst(i), results[i] });
+		}
+	}
+
+	static double elapsed_ms(std::chrono::steady_clock::time_point since) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+	}
+
+	void store_stats(bool ok, size_t files, double prepare_ms, double rename_ms) {
+		auto lck = stats_.AcquireLock();
+		*lck = JobStats{ ok, files, prepare_ms, rename_ms };
+	}
+
 	inline static std::wstring old_dir;
 
 	std::thread rename_thread;
 
+	// Scratch state of one worker; reused for every chunk the worker picks up.
+	struct EvalScratch {
+		calc::BatchEvaluator batch;
+		std::vector<std::wstring_view> names;
+	};
+
+	// New names of files [begin, end) into out[0, end - begin), relative to the directory
+	// of each file.
+	static void evaluate_chunk(const calc::Program& prog, const FileTable& vec_filepath, std::wstring* out, size_t begin, size_t end, EvalScratch& scratch) {
+		auto& names = scratch.names;
+		names.clear();
+		for (size_t i = begin; i < end; ++i) names.push_back(vec_filepath.name(i));
+
+		// The evaluator only gets the leaf names when the expression references OFNAME.
+		const std::wstring_view* bound = prog.uses(calc::VarSlot::OFNAME) ? names.data() : nullptr;
+		scratch.batch.run(prog, static_cast<int64_t>(begin), bound, names.size());
+
+		for (size_t i = begin; i < end; ++i) out[i - begin].assign(scratch.batch.result(i - begin));
+	}
+
+	// Computes the new name vec_newname[i] of every vec_filepath[i], block by block with the columnar evaluator.
+	// Every chunk writes only its own slots of vec_newname, so the result does not depend
+	// on which worker ran which chunk.
+	static void evaluate_names(const calc::Program& prog, const FileTable& vec_filepath, std::vector<std::wstring>& vec_newname) {
+		constexpr size_t CHUNK = calc::BatchEvaluator::CHUNK_ROWS;
+		const size_t total = vec_filepath.size();
+		vec_newname.assign(total, std::wstring());
+
+		if (total <= CHUNK) {
+			EvalScratch scratch;
+			evaluate_chunk(prog, vec_filepath, vec_newname.data(), 0, total, scratch);
+			return;
+		}
+
+		size_t chunks = (total + CHUNK - 1) / CHUNK;
+		aop::WorkStealingPool pool(std::min<size_t>(chunks, (std::max)(1u, std::thread::hardware_concurrency())));
+		std::vector<EvalScratch> scratch(pool.size());
+
+		pool.parallel_for(0, chunks, 1, [&](size_t first, size_t last) {
+			EvalScratch& own = scratch[aop::WorkStealingPool::current_worker()];
+			for (size_t c = first; c < last; ++c) {
+				evaluate_chunk(prog, vec_filepath, vec_newname.data() + c * CHUNK, c * CHUNK, (std::min)(total, (c + 1) * CHUNK), own);
+			}
+		});
+	}
+
+	// One block of a streaming job, from evaluation to renaming.
+	struct StreamBlock {
+		size_t first = 0;
+		std::vector<std::wstring> names;
+		RenamePlan plan;
+		std::vector<RenameResult> results;
+		size_t conflicts = 0;
+	};
+
+	// Blocks waiting between two stages of a streaming job.
+	static constexpr size_t STREAM_QUEUE = 2;
+
+	// The expression job with RenameOptions::streaming. One thread evaluates blocks of
+	// CHUNK_ROWS names, one plans and checks every block, and this thread renames them;
+	// bounded queues connect the stages, so only a few blocks are alive at once and
+	// renaming starts with the first block. A block with conflicts is not renamed.
+	// Returns whether every file was renamed; otherwise sets the result text.
+	bool rename_streaming(const calc::Program& prog, const FileTable& vec_filepath, const RenameOptions& opts, std::vector<RenameReport>& failures) {
+		constexpr size_t CHUNK = calc::BatchEvaluator::CHUNK_ROWS;
+		const size_t total = vec_filepath.size();
+		progress_.reset(total);
+
+		aop::BoundedQueue<StreamBlock> evaluated(STREAM_QUEUE);
+		aop::BoundedQueue<StreamBlock> checked(STREAM_QUEUE);
+
+		std::mutex err_mtx;
+		std::exception_ptr err;
+		auto fail_stage = [&](std::exception_ptr e) {
+			{
+				std::lock_guard<std::mutex> lck(err_mtx);
+				if (!err) err = e;
+			}
+			evaluated.close();
+			checked.close();
+		};
+
+		std::thread evaluator([&] {
+			try {
+				EvalScratch scratch;
+				for (size_t begin = 0; begin < total; begin += CHUNK) {
+					size_t end = (std::min)(total, begin + CHUNK);
+					StreamBlock block;
+					block.first = begin;
+					block.names.resize(end - begin);
+					evaluate_chunk(prog, vec_filepath, block.names.data(), begin, end, scratch);
+					if (!evaluated.push(std::move(block))) break;
+				}
+				evaluated.close();
+			} catch (...) {
+				fail_stage(std::current_exception());
+			}
+		});
+
+		std::thread checker([&] {
+			try {
+				StreamBlock block;
+				while (evaluated.pop(block)) {
+					block.plan = RenamePlan(vec_filepath, block.first, std::move(block.names), opts.fold_case);
+					// A block is small next to its directories, so stats beat listing them.
+					block.conflicts = CheckRenamePlan(block.plan, block.results, false);
+					if (!checked.push(std::move(block))) break;
+				}
+				checked.close();
+			} catch (...) {
+				fail_stage(std::current_exception());
+			}
+		});
+
+		size_t renamed = 0;
+		std::string first_error;
+		StreamBlock block;
+		RenameProgress block_progress;
+		try {
+			while (checked.pop(block)) {
+				const size_t n = block.plan.size();
+				size_t failed = 0;
+				if (block.conflicts == 0) {
+					failed = ExecuteRenamePlan(block.plan, opts, block.results, block_progress);
+				} else {
+					while (block.results[failed].status == RenameStatus::PENDING) ++failed;
+				}
+
+				size_t done = 0;
+				for (const auto& r : block.results) done += (r.status == RenameStatus::DONE);
+				renamed += done;
+				progress_.done.fetch_add(n, std::memory_order_relaxed);
+				progress_.failed.fetch_add(n - done, std::memory_order_relaxed);
+				collect_failures(block.plan, block.results, failures);
+
+				if (failed == n) continue;
+				if (first_error.empty()) first_error = block.results[failed].error;
+				if (opts.stop_on_error) break;
+			}
+		} catch (...) {
+			fail_stage(std::current_exception());
+		}
+
+		evaluated.close();
+		checked.close();
+		evaluator.join();
+		checker.join();
+
+		if (err) {
+			try {
+				std::rethrow_exception(err);
+			} catch (const std::exception& e) {
+				first_error = e.what();
+			} catch (...) {
+				first_error = "Unknown Error !";
+			}
+		} else if (renamed == total) {
+			return true;
+		}
+
+		std::wstringstream wss;
+		wss << first_error.c_str() << L" (renamed " << renamed << L" of " << total << L" files)";
+		{
+			auto lck = res_wstr.AcquireLock();
+			*lck = wss.str();
+		}
+		return false;
+	}
+
 	void rename_thread_assist_expr() {
 		state_.store(STATE_ONGOING, std::memory_order_release);
+		auto t_start = std::chrono::steady_clock::now();
 
-		std::vector<std::wstring> vec_filepath;
+		std::shared_ptr<const FileTable> files = vec_filepath_cache.pin();
+		const FileTable& vec_filepath = *files;
 		std::vector<std::wstring> vec_newname;
+		std::vector<RenameReport> failures;
 
+		RenameOptions opts;
 		{
-			auto lck = vec_filepath_cache.AcquireLock();
-			vec_filepath = *lck;
+			auto lck = rename_opts_.AcquireLock();
+			opts = *lck;
 		}
 
 		bool calc_flag = false;
+		calc::Program prog;
 		try {
-			auto lck = input_expr.AcquireLock();
-			// Check if pointer is valid before generating
-			if (lck->empty()) throw std::runtime_error("Expression is empty!");
-			std::vector<std::unique_ptr<calc::Element>> rpn = calc::generate_rpn(*lck);
-
-			for (size_t var_idex = 0; var_idex < vec_filepath.size(); ++var_idex) {
-				const std::wstring& ofname = vec_filepath[var_idex];
-				std::wstring new_filename = calc::calculate_rpn(calc::preprocess_rpn(rpn, var_idex, ofname));
-				std::filesystem::path src_path(ofname);
-				std::filesystem::path dst_path = src_path.parent_path() / new_filename;
-				vec_newname.emplace_back(dst_path.wstring());
+			{
+				auto lck = input_expr.AcquireLock();
+				// Check if pointer is valid before generating
+				if (lck->empty()) throw std::runtime_error("Expression is empty!");
+				prog = lck->compile();
 			}
 
+			// A streaming job evaluates block by block while it renames.
+			if (!opts.streaming) evaluate_names(prog, vec_filepath, vec_newname);
+
 			calc_flag = true;
 		} catch (const std::runtime_error& re) {
 			std::wstringstream wss;
@@ -91,43 +306,71 @@ private:
 			}
 		}
 
+		double prepare_ms = elapsed_ms(t_start);
+		auto t_rename = std::chrono::steady_clock::now();
+
 		bool rename_flag = false;
 		size_t vsize = vec_filepath.size();
-		if (calc_flag) {
-			try {
-				for (size_t i = 0; i < vsize; ++i) {
-
-					std::filesystem::path src(MakeLongPath(vec_filepath[i]));
-					std::filesystem::path dst(MakeLongPath(vec_newname[i]));
-
-					if (!std::filesystem::exists(src)) throw std::runtime_error("File doesn't exist !");
-					if (std::filesystem::exists(dst)) throw std::runtime_error("Target file already exists !");
-
-					std::filesystem::rename(src, dst);
-				}
-				rename_flag = true;
-			} catch (const std::filesystem::filesystem_error& e) {
-				std::wstringstream wss;
-				wss << e.what();
-				{
-					auto lck = res_wstr.AcquireLock();
-					*lck = wss.str();
-				}
-			} catch (const std::runtime_error& re) {
-				std::wstringstream wss;
-				wss << re.what();
-				{
-					auto lck = res_wstr.AcquireLock();
-					*lck = wss.str();
+		try {
+			if (calc_flag && opts.streaming) {
+				rename_flag = rename_streaming(prog, vec_filepath, opts, failures);
+			} else if (calc_flag) {
+				// The plan takes the directories from the table and only the new names from here.
+				RenamePlan plan(vec_filepath, 0, std::move(vec_newname), opts.fold_case);
+				std::vector<RenameResult> results;
+
+				// Nothing is renamed unless the whole plan is free of conflicts.
+				size_t conflicts = CheckRenamePlan(plan, results);
+				size_t failed = 0;
+				if (conflicts == 0) {
+					failed = ExecuteRenamePlan(plan, opts, results, progress_);
+				} else {
+					while (results[failed].status == RenameStatus::PENDING) ++failed;
 				}
-			} catch (...) {
-				std::wstringstream wss;
-				wss << "Unknown Error !";
-				{
-					auto lck = res_wstr.AcquireLock();
-					*lck = wss.str();
+
+				if (failed == vsize) {
+					rename_flag = true;
+				} else {
+					std::wstringstream wss;
+					wss << results[failed].error.c_str();
+					if (conflicts) wss << L" (" << conflicts << L" conflicts, nothing was renamed)";
+					{
+						auto lck = res_wstr.AcquireLock();
+						*lck = wss.str();
+					}
 				}
+
+				collect_failures(plan, results, failures);
+			}
+		} catch (const std::filesystem::filesystem_error& e) {
+			rename_flag = false;
+			std::wstringstream wss;
+			wss << e.what();
+			{
+				auto lck = res_wstr.AcquireLock();
+				*lck = wss.str();
 			}
+		} catch (const std::runtime_error& re) {
+			rename_flag = false;
+			std::wstringstream wss;
+			wss << re.what();
+			{
+				auto lck = res_wstr.AcquireLock();
+				*lck = wss.str();
+			}
+		} catch (...) {
+			rename_flag = false;
+			std::wstringstream wss;
+			wss << L"Unknown Error !";
+			{
+				auto lck = res_wstr.AcquireLock();
+				*lck = wss.str();
+			}
+		}
+
+		{
+			auto lck = failed_renames_.AcquireLock();
+			*lck = std::move(failures);
 		}
 
 		if (rename_flag && calc_flag) {
@@ -139,6 +382,8 @@ private:
 			}
 		}
 
+		store_stats(rename_flag && calc_flag, vsize, prepare_ms, calc_flag ? elapsed_ms(t_rename) : 0.0);
+
 		state_.store(STATE_READY, std::memory_order_release);
 		msg_box_.store(true, std::memory_order_release);
 		
@@ -146,32 +391,31 @@ private:
 
 	void rename_thread_assist_auto() {
 		state_.store(STATE_ONGOING, std::memory_order_release);
+		auto t_start = std::chrono::steady_clock::now();
+		bool ok = false;
+		double prepare_ms = 0.0;
+		double rename_ms = 0.0;
 
-		std::vector<std::wstring> vec_filepath;
-		std::vector<std::wstring> vec_newname;
-		{
-			auto lck = vec_filepath_cache.AcquireLock();
-			vec_filepath = *lck;
-		}
+		std::shared_ptr<const FileTable> files = vec_filepath_cache.pin();
 
 		std::vector<std::wstring> video_files;
 		std::vector<std::wstring> subtitle_files;
 		std::vector<std::wstring> other_files;
 
-		for (auto& path : vec_filepath) {
-			path = MakeLongPath(path);
+		for (size_t i = 0; i < files->size(); ++i) {
+			std::wstring path = MakeLongPath(files->path(i));
 
-			std::wstring ext = std::filesystem::path(path).extension().wstring();
+			std::wstring ext = FromFsPath(ToFsPath(path).extension());
 			for (auto& c : ext) {
 				if (c >= L'A' && c <= L'Z') c = c - L'A' + L'a';
 			}
 
 			if (ext == L".mp4" || ext == L".mkv" || ext == L".avi" || ext == L".wmv" || ext == L".mov" || ext == L".flv") {
-				video_files.push_back(path);
+				video_files.push_back(std::move(path));
 			} else if (ext == L".srt" || ext == L".ass" || ext == L".ssa" || ext == L".vtt") {
-				subtitle_files.push_back(path);
+				subtitle_files.push_back(std::move(path));
 			} else {
-				other_files.push_back(path);
+				other_files.push_back(std::move(path));
 			}
 		}
 
@@ -182,14 +426,18 @@ private:
 				auto lck = res_wstr.AcquireLock();
 				*lck = wss.str();
 			}
+			prepare_ms = elapsed_ms(t_start);
 		} else {
 			std::sort(video_files.begin(), video_files.end());
 			std::sort(subtitle_files.begin(), subtitle_files.end());
 
+			prepare_ms = elapsed_ms(t_start);
+			auto t_rename = std::chrono::steady_clock::now();
+
 			try {
 				for (size_t i = 0; i < video_files.size(); ++i) {
-					std::filesystem::path v_path(video_files[i]);
-					std::filesystem::path s_path(subtitle_files[i]);
+					std::filesystem::path v_path = ToFsPath(video_files[i]);
+					std::filesystem::path s_path = ToFsPath(subtitle_files[i]);
 
 					std::filesystem::path new_s_path = v_path;
 					new_s_path.replace_extension(s_path.extension());
@@ -208,6 +456,7 @@ private:
 					auto lck = res_wstr.AcquireLock();
 					*lck = wss.str();
 				}
+				ok = true;
 			} catch (const std::filesystem::filesystem_error& e) {
 				std::wstringstream wss;
 				wss << e.what();
@@ -230,32 +479,38 @@ private:
 					*lck = wss.str();
 				}
 			}
+			rename_ms = elapsed_ms(t_rename);
 		}
 
+		store_stats(ok, subtitle_files.size(), prepare_ms, rename_ms);
+
 		state_.store(STATE_READY, std::memory_order_release);
 		msg_box_.store(true, std::memory_order_release);
 	}
 
-	inline static std::unordered_map< int64_t, std::function< std::wstring(const std::unique_ptr<calc::Element>&) > > func_umap {
+	inline static std::unordered_map< int64_t, std::function< std::wstring(const calc::Element&) > > func_umap {
 		{
 			'S',
-			[](const std::unique_ptr<calc::Element>& elem) -> std::wstring {
-				auto str_ptr = static_cast<calc::Str*>(elem.get());
-				return L"\"" + str_ptr->get_str() + L"\" ";
+			[](const calc::Element& elem) -> std::wstring {
+				// Escaped so that the preview reads back through calc::parse_expression().
+				std::wstring txt = L"\"";
+				for (wchar_t c : elem.get_str()) {
+					if (c == L'"' || c == L'\\') txt.push_back(L'\\');
+					txt.push_back(c);
+				}
+				return txt + L"\" ";
 			}
 		},
 		{
 			'Z',
-			[](const std::unique_ptr<calc::Element>& elem) -> std::wstring {
-				auto int_ptr = static_cast<calc::Int64*>(elem.get());
-				return int_ptr->get_str() + L" ";
+			[](const calc::Element& elem) -> std::wstring {
+				return elem.get_str() + L" ";
 			}
 		},
 		{
 			'X',
-			[](const std::unique_ptr<calc::Element>& elem) -> std::wstring {
-				auto var_ptr = static_cast<calc::Var*>(elem.get());
-				int64_t var_type = var_ptr->get_var_type();
+			[](const calc::Element& elem) -> std::wstring {
+				int64_t var_type = elem.get_var_type();
 				if (var_type == 'I') {
 					return L"INDEX ";
 				} else if (var_type == 'N') {
@@ -267,33 +522,31 @@ private:
 		},
 		{
 			'(',
-			[](const std::unique_ptr<calc::Element>& elem) -> std::wstring {
+			[](const calc::Element& elem) -> std::wstring {
 				(void)elem;
 				return L"( ";
 			}
 		},
 		{
 			')',
-			[](const std::unique_ptr<calc::Element>& elem) -> std::wstring {
+			[](const calc::Element& elem) -> std::wstring {
 				(void)elem;
 				return L") ";
 			}
 		},
 		{
 			'#',
-			[](const std::unique_ptr<calc::Element>& elem) -> std::wstring {
-				auto opt_ptr = static_cast<calc::Int64Opt*>(elem.get());
+			[](const calc::Element& elem) -> std::wstring {
 				std::wstringstream wss;
-				wss << (wchar_t)opt_ptr->get_opt_type() << L" ";
+				wss << (wchar_t)elem.get_opt_type() << L" ";
 				return wss.str();
 			}
 		},
 		{
 			'F',
-			[](const std::unique_ptr<calc::Element>& elem) -> std::wstring {
-				auto fptr = static_cast<calc::Int64_Format*>(elem.get());
+			[](const calc::Element& elem) -> std::wstring {
 				std::wstringstream wss;
-				wss << L"NUM_FORMAT_" << fptr->get_min_length() << L" ";
+				wss << L"NUM_FORMAT_" << elem.get_min_length() << L" ";
 				return wss.str();
 			}
 		},
@@ -352,21 +605,128 @@ public:
 	bool reset_selected_file() {
 		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return false;
 
-		{
-			auto lck = vec_filepath_cache.AcquireLock();
-			lck->clear();
-		}
+		vec_filepath_cache.replace({});
 
 		return true;
 	}
 
-	bool push_filepath(const std::wstring& filepath) {
+	PushStatus push_filepath(std::wstring_view filepath) {
+		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return PushStatus::BUSY;
+
+		bool added = vec_filepath_cache.edit([&](FileTable& table) { return table.push(filepath); });
+
+		return added ? PushStatus::ADDED : PushStatus::DUPLICATE;
+	}
+
+	// Adds many paths in one step, with room reserved up front; status[i] tells what became
+	// of paths[i]. paths is consumed.
+	std::vector<PushStatus> push_filepaths(std::vector<std::wstring>&& paths) {
+		std::vector<PushStatus> status(paths.size(), PushStatus::BUSY);
+		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return status;
+
+		size_t chars = 0;
+		for (const auto& path : paths) chars += FileNameView(path).size();
+
+		vec_filepath_cache.edit([&](FileTable& table) {
+			table.reserve(table.size() + paths.size(), table.name_chars() + chars);
+			for (size_t i = 0; i < paths.size(); ++i) {
+				status[i] = table.push(paths[i]) ? PushStatus::ADDED : PushStatus::DUPLICATE;
+			}
+		});
+		std::vector<std::wstring>().swap(paths);
+
+		return status;
+	}
+
+	// Directories read by a scan but not yet in the table.
+	static constexpr size_t SCAN_QUEUE = 64;
+
+	// Adds the files under root straight into the table. The tree is walked on a thread of
+	// its own, and this thread adds each directory the scanner delivers with one short edit,
+	// so readers of the file list only wait for one directory at a time, no path string is
+	// built, and at most SCAN_QUEUE batches wait. The new files are then sorted by
+	// directory, and by name within one: renaming by INDEX relies on the same tree always
+	// giving the same order. duplicates counts those already selected.
+	bool push_directory(std::wstring_view root, const ScanOptions& opts, ScanStats& stats, size_t& duplicates) {
 		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return false;
 
-		{
-			auto lck = vec_filepath_cache.AcquireLock();
-			lck->emplace_back(filepath);
+		aop::BoundedQueue<ScanBatch> batches(SCAN_QUEUE);
+		std::exception_ptr err;
+		std::thread scanner([&] {
+			try {
+				stats = ScanDirectoryStream(root, opts, [&](ScanBatch&& batch) { batches.push(std::move(batch)); });
+			} catch (...) {
+				err = std::current_exception();
+			}
+			batches.close();
+		});
+
+		duplicates = 0;
+		size_t first = 0;
+		try {
+			first = vec_filepath_cache.read([](const FileTable& table) { return table.size(); });
+			ScanBatch batch;
+			while (batches.pop(batch)) {
+				size_t added = vec_filepath_cache.edit([&](FileTable& table) { return table.push(batch.dir, batch.names); });
+				duplicates += batch.names.size() - added;
+			}
+		} catch (...) {
+			batches.close();
+			scanner.join();
+			throw;
 		}
+		scanner.join();
+		if (err) std::rethrow_exception(err);
+
+		vec_filepath_cache.edit([&](FileTable& table) { table.sort_by_dir(first); });
+
+		return true;
+	}
+
+	// Calls fn(path) for every selected file from first on, in list order.
+	template <typename Fn>
+	void for_each_file(size_t first, Fn&& fn) {
+		vec_filepath_cache.read([&](const FileTable& table) {
+			for (size_t i = first; i < table.size(); ++i) fn(table.path(i));
+		});
+	}
+
+	// Drops the selected files from count on, to undo an add the caller cannot complete.
+	bool truncate_files(size_t count) {
+		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return false;
+
+		vec_filepath_cache.edit([&](FileTable& table) { table.truncate(count); });
+
+		return true;
+	}
+
+	// Adds the UTF-8 paths listed in a file, separated by sep as ForEachListEntry reads
+	// them. The file is mapped instead of read, and every path is decoded straight into the
+	// table. Throws std::runtime_error when the file cannot be opened.
+	bool push_filelist(const std::wstring& list_path, char sep, size_t& added, size_t& duplicates) {
+		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return false;
+
+		MappedFile list(list_path);
+
+		// A first pass over the mapping sizes the table: growing a name arena of gigabytes
+		// step by step costs more than reading the list twice. A name never decodes to more
+		// characters than it has bytes.
+		size_t files = 0;
+		size_t chars = 0;
+		ForEachListEntry(list.view(), sep, [&](std::string_view path) {
+			++files;
+			chars += path.size() - FileTable::utf8_dir(path).size();
+		});
+
+		added = 0;
+		duplicates = 0;
+		vec_filepath_cache.edit([&](FileTable& table) {
+			table.reserve(table.size() + files, table.name_chars() + chars);
+			ForEachListEntry(list.view(), sep, [&](std::string_view path) {
+				if (table.push_utf8(path)) ++added;
+				else ++duplicates;
+			});
+		});
 
 		return true;
 	}
@@ -387,26 +747,64 @@ public:
 
 		{
 			auto lck = input_expr.AcquireLock();
-			if (!lck->empty()) {
-				lck->pop_back();
-			}
+			lck->pop();
 		}
 
 		return true;
 	}
 
-	template <typename PtrType, typename... Args>
+	template <typename ElemType, typename... Args>
 	bool push_expr(Args&&... args) {
 		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return false;
 
 		{
 			auto lck = input_expr.AcquireLock();
-			lck->emplace_back(std::make_unique<PtrType>(std::forward<Args>(args)...));
+			lck->push(ElemType(std::forward<Args>(args)...));
+		}
+
+		return true;
+	}
+
+	// Replaces the expression by the one written in text, in the syntax of the preview.
+	// Throws on a syntax error and leaves the current expression alone; returns false while
+	// a job is running. Whether the expression compiles is reported by get_expression_status().
+	bool set_expr_text(std::wstring_view text) {
+		if (state_.load(std::memory_order_acquire) == STATE_ONGOING) return false;
+
+		calc::IncrementalRpn parsed;
+		calc::parse_expression(text, parsed);
+
+		{
+			auto lck = input_expr.AcquireLock();
+			std::swap(*lck, parsed);
 		}
 
 		return true;
 	}
 
+	// Takes effect from the next job.
+	void set_rename_options(const RenameOptions& opts) {
+		auto lck = rename_opts_.AcquireLock();
+		*lck = opts;
+	}
+
+	// Renames finished and planned in the running or last job.
+	std::pair<size_t, size_t> get_progress() const {
+		return { progress_.done.load(std::memory_order_relaxed), progress_.total.load(std::memory_order_relaxed) };
+	}
+
+	// Every rename of the last expression job that did not succeed or was refused by the
+	// conflict check, in plan order.
+	std::vector<RenameReport> get_failed_renames() {
+		auto lck = failed_renames_.AcquireLock();
+		return *lck;
+	}
+
+	JobStats get_last_stats() {
+		auto lck = stats_.AcquireLock();
+		return *lck;
+	}
+
 	std::wstring get_res_wstr() {
 		auto lck = res_wstr.AcquireLock();
 		return *lck;
@@ -429,8 +827,8 @@ public:
 		}
 
 		std::vector<std::pair<int64_t, std::wstring>> tokens;
-		for (const auto& elem : *lck) {
-			int64_t type = elem->get_type();
+		for (const auto& elem : lck->tokens()) {
+			int64_t type = elem.get_type();
 			std::wstring txt;
 			try {
 				txt = func_umap.at(type)(elem);
@@ -443,6 +841,16 @@ public:
 		return tokens;
 	}
 
+	// Empty when the current expression compiles, otherwise the error a submit would report.
+	// Kept up to date by push_expr()/pop_expr_ptr(), so it is cheap enough for live validation.
+	std::wstring get_expression_status() {
+		auto lck = input_expr.AcquireLock();
+		if (lck->empty()) return {};
+
+		const std::string& status = lck->status();
+		return std::wstring(status.begin(), status.end());
+	}
+
 	void join() {
 		if(rename_thread.joinable()) {
 			rename_thread.join();
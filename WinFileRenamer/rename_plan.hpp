@@ -0,0 +1,1012 @@
+﻿#ifndef _RENAME_PLAN_HPP
+#define _RENAME_PLAN_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cwctype>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "file_table.hpp"
+#include "fs_path.hpp"
+#include "platform_fs.hpp"
+#include "uring.hpp"
+#include "work_pool.hpp"
+
+namespace pt {
+
+enum class RenameStatus : uint8_t {
+	PENDING,
+	DONE,
+	SKIPPED,			// not attempted because an earlier rename failed
+	SOURCE_MISSING,
+	TARGET_EXISTS,
+	DUPLICATE,			// source or target listed twice in the plan
+	FAILED,
+};
+
+struct RenameResult {
+	RenameStatus status = RenameStatus::PENDING;
+	std::string error;	// set for every status but DONE
+};
+
+// Live counters of a running plan; readable from any thread.
+struct RenameProgress {
+	std::atomic<size_t> total{ 0 };
+	std::atomic<size_t> done{ 0 };		// finished, skipped or failed
+	std::atomic<size_t> failed{ 0 };
+
+	void reset(size_t n) {
+		total.store(n, std::memory_order_relaxed);
+		done.store(0, std::memory_order_relaxed);
+		failed.store(0, std::memory_order_relaxed);
+	}
+};
+
+enum class RenameBackend : uint8_t {
+	THREADS,			// blocking calls on a pool of workers
+	IO_URING,			// queued to io_uring from one thread (Linux)
+};
+
+struct RenameOptions {
+	// Shards renamed at the same time; 0 uses one per hardware thread. Renames mostly
+	// wait on the file system, so network shares profit from more than that.
+	size_t concurrency = 0;
+	// Stop starting new renames once one fails. Renames already in flight still finish:
+	// one per worker on the THREADS backend, up to queue_depth on IO_URING.
+	bool stop_on_error = true;
+	// Treat names that differ only in case as the same file.
+	bool fold_case = DEFAULT_FOLD_CASE;
+	// Rename with the platform's atomic no-replace call where there is one, instead of
+	// checking source and target first (three system calls and a race window).
+	bool atomic_rename = true;
+	// How renames are issued. IO_URING needs atomic_rename; where io_uring is not
+	// available, or without atomic_rename, the threads run instead.
+	RenameBackend backend = RenameBackend::THREADS;
+	// Renames in flight at once on the IO_URING backend.
+	size_t queue_depth = 256;
+	// Evaluate, check and rename a job block by block in a pipeline instead of planning it
+	// as a whole, so disk work starts at once and memory does not grow with the job.
+	// Ordering and the conflict check then only see one block at a time: a target that is
+	// the source of another block is refused as existing instead of being moved first.
+	bool streaming = false;
+};
+
+// Renames src(i) -> dst(i), split into shards that can run concurrently.
+//
+// Renames that share a path (a -> b, b -> c) depend on each other, so every connected
+// component of the "shares a path" relation stays in one shard. Inside it, a rename runs
+// after the rename that moves its target out of the way, so chains run back to front.
+// Once every source and target is unique (see CheckRenamePlan) each component is a
+// chain or a cycle; a cycle (a -> b, b -> a) is broken by moving one of its files to a
+// temporary name first and to its target last, one temporary name per cycle.
+//
+// Components are grouped by the parent directory of their first source, and a
+// directory is cut into shards of about SHARD_OPS renames, so one large folder still
+// spreads over the workers while each shard stays inside one folder.
+//
+// A path is kept as its directory, stored once, plus its name in one character arena,
+// the same split a FileTable makes; src(i) and dst(i) are put together on demand. Every
+// distinct path and every distinct parent directory gets a dense id, so the checks over
+// the whole plan compare integers instead of strings.
+class RenamePlan {
+public:
+	static constexpr size_t SHARD_OPS = 256;
+	static constexpr uint32_t NONE = 0xffffffffu;
+
+	enum class Phase : uint8_t {
+		WHOLE,			// src -> dst
+		TO_TEMP,		// src -> temp, first half of a broken cycle
+		FROM_TEMP,		// temp -> dst
+	};
+
+	struct Step {
+		uint32_t op;
+		Phase phase;
+		bool first = false;		// first step of its component; a component's steps are contiguous
+	};
+
+private:
+	struct Name {
+		uint32_t spelling;		// into spellings_
+		uint32_t len;
+		uint64_t off;			// into names_
+	};
+
+	struct PathKey {
+		uint32_t dir;
+		std::wstring_view name;
+		bool operator==(const PathKey&) const = default;
+	};
+
+	struct PathHash {
+		size_t operator()(const PathKey& k) const { return std::hash<std::wstring_view>{}(k.name) ^ (0x9E3779B97F4A7C15ull * (k.dir + 1)); }
+	};
+
+	using PathIds = std::unordered_map<PathKey, uint32_t, PathHash>;
+
+	bool fold_case_ = DEFAULT_FOLD_CASE;
+
+	std::vector<std::wstring> spellings_;	// every parent directory as written, with its separator
+	std::wstring names_;
+	std::vector<Name> src_;
+	std::vector<Name> dst_;
+
+	std::vector<uint32_t> src_id_;			// path ids
+	std::vector<uint32_t> dst_id_;
+	std::vector<uint32_t> src_dir_;			// directory ids
+	std::vector<uint32_t> dst_dir_;
+	std::vector<uint32_t> dirs_;			// a spelling of every directory
+	size_t path_count_ = 0;
+
+	std::vector<uint32_t> temp_of_;			// index into temps_, or NONE
+	std::vector<std::wstring> temps_;
+
+	std::vector<Step> steps_;				// shard by shard, in execution order
+	std::vector<size_t> shard_begin_;		// shard k is steps_[shard_begin_[k], shard_begin_[k + 1])
+
+	std::wstring_view name_of(const Name& n) const { return std::wstring_view(names_).substr(n.off, n.len); }
+
+	std::wstring path_of(const Name& n) const {
+		const std::wstring& dir = spellings_[n.spelling];
+		std::wstring out;
+		out.reserve(dir.size() + n.len);
+		out.append(dir).append(name_of(n));
+		return out;
+	}
+
+	Name add_name(uint32_t spelling, std::wstring_view name) {
+		Name n{ spelling, static_cast<uint32_t>(name.size()), names_.size() };
+		names_.append(name);
+		return n;
+	}
+
+	// Key under which spellings of one name compare equal. With case folding the key is
+	// built in storage, which must have room reserved so the returned views stay valid.
+	std::wstring_view stored_key(std::wstring_view name, std::vector<std::wstring>& storage) const {
+		if (!fold_case_) return name;
+		std::wstring& key = storage.emplace_back();
+		return fold_key(name, key);
+	}
+
+	void build() {
+		const size_t n = src_.size();
+		src_id_.resize(n);
+		dst_id_.resize(n);
+		src_dir_.resize(n);
+		dst_dir_.resize(n);
+		dirs_.clear();
+		temp_of_.assign(n, NONE);
+		temps_.clear();
+		steps_.clear();
+		shard_begin_.assign(1, 0);
+		if (n == 0) return;
+
+		std::vector<std::wstring> keys;
+		keys.reserve(fold_case_ ? 2 * n + spellings_.size() : 0);
+
+		// Spellings of one directory share its id.
+		std::vector<uint32_t> dir_of(spellings_.size());
+		std::unordered_map<std::wstring_view, uint32_t> dirs;
+		for (uint32_t s = 0; s < spellings_.size(); ++s) {
+			auto [it, inserted] = dirs.try_emplace(stored_key(spellings_[s], keys), static_cast<uint32_t>(dirs_.size()));
+			if (inserted) dirs_.push_back(s);
+			dir_of[s] = it->second;
+		}
+
+		PathIds paths;
+		paths.reserve(2 * n);
+		auto path_id = [&](uint32_t d, const Name& name) -> uint32_t {
+			return paths.try_emplace(PathKey{ d, stored_key(name_of(name), keys) }, static_cast<uint32_t>(paths.size())).first->second;
+		};
+
+		for (size_t i = 0; i < n; ++i) {
+			src_dir_[i] = dir_of[src_[i].spelling];
+			dst_dir_[i] = dir_of[dst_[i].spelling];
+			src_id_[i] = path_id(src_dir_[i], src_[i]);
+			dst_id_[i] = path_id(dst_dir_[i], dst_[i]);
+		}
+		path_count_ = paths.size();
+
+		// Union-find over the paths.
+		std::vector<uint32_t> parent(path_count_);
+		for (uint32_t p = 0; p < parent.size(); ++p) parent[p] = p;
+		auto find = [&](uint32_t x) -> uint32_t {
+			while (parent[x] != x) {
+				parent[x] = parent[parent[x]];
+				x = parent[x];
+			}
+			return x;
+		};
+		for (size_t i = 0; i < n; ++i) {
+			uint32_t a = find(src_id_[i]);
+			uint32_t b = find(dst_id_[i]);
+			if (a != b) parent[(std::max)(a, b)] = (std::min)(a, b);
+		}
+
+		order_steps(paths);
+
+		// Every component is placed by its first rename: that rename's directory, then its index.
+		std::vector<uint32_t> first_op(path_count_, NONE);
+		std::vector<uint32_t> comp(n);
+		for (size_t i = 0; i < n; ++i) {
+			comp[i] = find(src_id_[i]);
+			if (first_op[comp[i]] == NONE) first_op[comp[i]] = static_cast<uint32_t>(i);
+		}
+		auto comp_dir = [&](uint32_t root) { return src_dir_[first_op[root]]; };
+
+		// Stable, so each component keeps the dependency order from order_steps().
+		std::stable_sort(steps_.begin(), steps_.end(), [&](const Step& a, const Step& b) {
+			uint32_t ra = comp[a.op], rb = comp[b.op];
+			if (comp_dir(ra) != comp_dir(rb)) return comp_dir(ra) < comp_dir(rb);
+			return first_op[ra] < first_op[rb];
+		});
+
+		// Cut at directory changes, and at component boundaries once a shard is full.
+		for (size_t k = 1; k < steps_.size(); ++k) {
+			uint32_t prev = comp[steps_[k - 1].op], cur = comp[steps_[k].op];
+			if (prev == cur) continue;
+			if (comp_dir(prev) != comp_dir(cur) || k - shard_begin_.back() >= SHARD_OPS) shard_begin_.push_back(k);
+		}
+		shard_begin_.push_back(steps_.size());
+
+		for (size_t k = 0; k < steps_.size(); ++k) steps_[k].first = (k == 0 || comp[steps_[k - 1].op] != comp[steps_[k].op]);
+	}
+
+	// Topological order of the renames: rename i waits for the rename that reads dst(i).
+	// When only cycles are left, the first remaining rename of the plan goes to a temporary
+	// name, which frees its source and lets the rest of its cycle run.
+	void order_steps(const PathIds& paths) {
+		const size_t n = src_.size();
+		steps_.reserve(n);
+
+		std::vector<uint32_t> reader(path_count_, NONE);
+		for (size_t i = 0; i < n; ++i) {
+			if (reader[src_id_[i]] == NONE) reader[src_id_[i]] = static_cast<uint32_t>(i);
+		}
+
+		// blocked_by[i] is the rename that must free dst(i) first; the renames it
+		// unblocks are linked from first_dep[j] through next_dep.
+		std::vector<uint32_t> first_dep(n, NONE);
+		std::vector<uint32_t> next_dep(n, NONE);
+		std::vector<uint8_t> waiting(n, 0);
+		for (size_t i = 0; i < n; ++i) {
+			uint32_t j = reader[dst_id_[i]];
+			if (j == NONE || j == i) continue;
+			waiting[i] = 1;
+			next_dep[i] = first_dep[j];
+			first_dep[j] = static_cast<uint32_t>(i);
+		}
+
+		std::vector<uint32_t> ready;
+		for (size_t i = n; i-- > 0;) {
+			if (!waiting[i]) ready.push_back(static_cast<uint32_t>(i));
+		}
+
+		enum : uint8_t { PENDING, IN_TEMP, PLACED };
+		std::vector<uint8_t> state(n, PENDING);
+
+		auto release = [&](uint32_t j) {
+			for (uint32_t i = first_dep[j]; i != NONE; i = next_dep[i]) {
+				if (--waiting[i] == 0) ready.push_back(i);
+			}
+		};
+
+		size_t placed = 0, scan = 0;
+		while (placed < n) {
+			while (!ready.empty()) {
+				uint32_t i = ready.back();
+				ready.pop_back();
+				if (state[i] == IN_TEMP) {
+					steps_.push_back({ i, Phase::FROM_TEMP });
+				} else {
+					steps_.push_back({ i, Phase::WHOLE });
+					release(i);
+				}
+				state[i] = PLACED;
+				++placed;
+			}
+			if (placed == n) break;
+
+			while (state[scan] != PENDING) ++scan;
+			uint32_t c = static_cast<uint32_t>(scan);
+			temp_of_[c] = static_cast<uint32_t>(temps_.size());
+			temps_.push_back(make_temp(c, paths));
+			steps_.push_back({ c, Phase::TO_TEMP });
+			state[c] = IN_TEMP;
+			release(c);
+		}
+	}
+
+	// A name next to src(i) that no path of the plan uses.
+	std::wstring make_temp(uint32_t i, const PathIds& paths) const {
+		for (uint32_t k = 0;; ++k) {
+			std::wstring temp(L"~wfr");
+			temp.append(std::to_wstring(i));
+			if (k) temp.append(L"_").append(std::to_wstring(k));
+			temp.append(L".tmp");
+
+			std::wstring key;
+			if (paths.find(PathKey{ src_dir_[i], fold_key(temp, key) }) == paths.end()) return spellings_[src_[i].spelling] + temp;
+		}
+	}
+
+public:
+	RenamePlan() : shard_begin_(1, 0) {}
+
+	// Renames files[first + i] to names[i] for every i: a name relative to the directory of
+	// its file, where it usually stays, or a rooted path that replaces it. Directories go to
+	// the OS as MakeLongPath makes them. Each name is released as soon as the plan holds it.
+	RenamePlan(const FileTable& files, size_t first, std::vector<std::wstring> names, bool fold_case = DEFAULT_FOLD_CASE)
+		: fold_case_(fold_case) {
+		const size_t n = names.size();
+		src_.reserve(n);
+		dst_.reserve(n);
+
+		size_t chars = 0;
+		for (size_t i = 0; i < n; ++i) chars += files.name(first + i).size() + names[i].size();
+		names_.reserve(chars);
+
+		// A spelling of every directory of the table, as first needed, and of the other
+		// directories that names lead into.
+		std::vector<uint32_t> table_spelling(files.dir_count(), NONE);
+		std::unordered_map<std::wstring, uint32_t> other;
+		auto spelling = [&](std::wstring dir) -> uint32_t {
+			auto [it, inserted] = other.try_emplace(std::move(dir), static_cast<uint32_t>(spellings_.size()));
+			if (inserted) spellings_.push_back(it->first);
+			return it->second;
+		};
+
+		for (size_t i = 0; i < n; ++i) {
+			const uint32_t d = files.dir_id(first + i);
+			if (table_spelling[d] == NONE) table_spelling[d] = spelling(MakeLongPath(files.dir_name(d)));
+			src_.push_back(add_name(table_spelling[d], files.name(first + i)));
+
+			std::wstring& name = names[i];
+			if (FileNameView(name).size() == name.size()) {
+				dst_.push_back(add_name(table_spelling[d], name));
+			} else {
+				// A rooted name replaces the directory, as parent_path() / name would.
+				std::filesystem::path target = ToFsPath(name);
+				std::wstring path = MakeLongPath((target.has_root_name() || target.has_root_directory()) ? name : files.dir_name(d) + name);
+				std::wstring_view leaf = FileNameView(path);
+				uint32_t s = spelling(path.substr(0, path.size() - leaf.size()));
+				dst_.push_back(add_name(s, leaf));
+			}
+			std::wstring().swap(name);
+		}
+		build();
+	}
+
+	size_t size() const { return src_.size(); }
+	std::wstring src(size_t i) const { return path_of(src_[i]); }
+	std::wstring dst(size_t i) const { return path_of(dst_[i]); }
+	std::wstring_view src_name(size_t i) const { return name_of(src_[i]); }
+	std::wstring_view dst_name(size_t i) const { return name_of(dst_[i]); }
+
+	// Whether dst(i) is src(i) exactly, so there is nothing to rename.
+	bool unchanged(size_t i) const { return src_[i].spelling == dst_[i].spelling && src_name(i) == dst_name(i); }
+
+	bool fold_case() const { return fold_case_; }
+
+	// Folds name into out when the plan ignores case; returns the key to compare.
+	std::wstring_view fold_key(std::wstring_view name, std::wstring& out) const {
+		if (!fold_case_) return name;
+		out.assign(name);
+		for (auto& c : out) c = static_cast<wchar_t>(std::towupper(c));
+		return out;
+	}
+
+	size_t path_count() const { return path_count_; }
+	uint32_t src_id(size_t i) const { return src_id_[i]; }
+	uint32_t dst_id(size_t i) const { return dst_id_[i]; }
+
+	size_t dir_count() const { return dirs_.size(); }
+	std::wstring_view dir(uint32_t d) const { return spellings_[dirs_[d]]; }
+	uint32_t src_dir(size_t i) const { return src_dir_[i]; }
+	uint32_t dst_dir(size_t i) const { return dst_dir_[i]; }
+
+	// Temporary name of rename i when it breaks a cycle, otherwise null.
+	const std::wstring* temp(size_t i) const { return (temp_of_[i] == NONE) ? nullptr : &temps_[temp_of_[i]]; }
+	size_t temp_count() const { return temps_.size(); }
+
+	std::wstring step_src(const Step& st) const { return (st.phase == Phase::FROM_TEMP) ? temps_[temp_of_[st.op]] : src(st.op); }
+	std::wstring step_dst(const Step& st) const { return (st.phase == Phase::TO_TEMP) ? temps_[temp_of_[st.op]] : dst(st.op); }
+	// Directory ids of step_src / step_dst; temporary names live next to the source.
+	uint32_t step_src_dir(const Step& st) const { return src_dir_[st.op]; }
+	uint32_t step_dst_dir(const Step& st) const { return (st.phase == Phase::TO_TEMP) ? src_dir_[st.op] : dst_dir_[st.op]; }
+
+	size_t step_count() const { return steps_.size(); }
+	size_t shard_count() const { return shard_begin_.size() - 1; }
+
+	// Steps of shard k, in the order they must run.
+	std::span<const Step> shard(size_t k) const {
+		return std::span<const Step>(steps_.data() + shard_begin_[k], shard_begin_[k + 1] - shard_begin_[k]);
+	}
+};
+
+// Finds, before anything is renamed, every rename of the plan that would fail or
+// clobber another: a missing source, a source or target listed twice, or a target that
+// already exists and is not itself renamed by the plan. Temporary names for cycles
+// must not exist either.
+//
+// Each directory the plan touches is listed once, and all lookups go through hash sets,
+// so the check costs O(n + files in those directories) instead of two stats per file.
+// A directory that cannot be listed falls back to stats for its files, and so do all of
+// them without list_dirs, for small plans in large directories.
+//
+// Conflicting renames get their status and message in results, the others stay PENDING.
+// Returns the number of conflicts.
+inline size_t CheckRenamePlan(const RenamePlan& plan, std::vector<RenameResult>& results, bool list_dirs = true) {
+	constexpr uint32_t NONE = RenamePlan::NONE;
+	const size_t n = plan.size();
+	results.assign(n, RenameResult());
+
+	struct KeyHash {
+		using is_transparent = void;
+		size_t operator()(std::wstring_view s) const { return std::hash<std::wstring_view>{}(s); }
+	};
+	using NameSet = std::unordered_set<std::wstring, KeyHash, std::equal_to<>>;
+
+	// Names present in every directory, listed on first use.
+	std::vector<NameSet> listing(plan.dir_count());
+	std::vector<uint8_t> listed(plan.dir_count(), list_dirs ? 0 : 2);	// 0 not yet, 1 listed, 2 failed
+	std::wstring key;
+
+	// Whether name exists in directory d; path() gives its full path for a stat.
+	auto on_disk = [&](uint32_t d, std::wstring_view name, auto&& path) -> bool {
+		if (listed[d] == 0) {
+			listed[d] = 2;
+			try {
+				std::wstring_view dir = plan.dir(d);
+				std::filesystem::path dir_path = ToFsPath(dir.empty() ? std::wstring(L".") : std::wstring(dir));
+				for (const auto& entry : std::filesystem::directory_iterator(dir_path)) {
+					std::wstring found = FromFsPath(entry.path().filename());
+					listing[d].emplace(plan.fold_key(found, key));
+				}
+				listed[d] = 1;
+			} catch (const std::exception&) {
+				listing[d].clear();
+			}
+		}
+		if (listed[d] == 1) return listing[d].find(plan.fold_key(name, key)) != listing[d].end();
+
+		std::error_code ec;
+		return std::filesystem::exists(ToFsPath(path()), ec);
+	};
+
+	// First rename that reads / writes every path. A target with a reader is moved out of
+	// the way before it is written, in the order RenamePlan chose.
+	std::vector<uint32_t> reader(plan.path_count(), NONE);
+	std::vector<uint32_t> writer(plan.path_count(), NONE);
+	for (size_t i = 0; i < n; ++i) {
+		if (reader[plan.src_id(i)] == NONE) reader[plan.src_id(i)] = static_cast<uint32_t>(i);
+		if (writer[plan.dst_id(i)] == NONE) writer[plan.dst_id(i)] = static_cast<uint32_t>(i);
+	}
+
+	size_t conflicts = 0;
+	auto conflict = [&](size_t i, RenameStatus status, const char* msg) {
+		results[i].status = status;
+		results[i].error = msg;
+		++conflicts;
+	};
+
+	for (size_t i = 0; i < n; ++i) {
+		const uint32_t s = plan.src_id(i), t = plan.dst_id(i);
+
+		if (reader[s] != i) {
+			conflict(i, RenameStatus::DUPLICATE, "File is listed twice !");
+		} else if (writer[t] != i) {
+			conflict(i, RenameStatus::DUPLICATE, "Two files would get the same name !");
+		} else if (!on_disk(plan.src_dir(i), plan.src_name(i), [&] { return plan.src(i); })) {
+			conflict(i, RenameStatus::SOURCE_MISSING, "File doesn't exist !");
+		} else if (s == t) {
+			// Unchanged, or a change of case only: where case matters, the target may be another file.
+			std::string error;
+			if (!plan.unchanged(i) && SameFile(plan.src(i), plan.dst(i), error) == FsError::EXISTS) {
+				conflict(i, RenameStatus::TARGET_EXISTS, "Target file already exists !");
+			}
+		} else if (reader[t] == NONE && on_disk(plan.dst_dir(i), plan.dst_name(i), [&] { return plan.dst(i); })) {
+			conflict(i, RenameStatus::TARGET_EXISTS, "Target file already exists !");
+		} else if (plan.temp(i) && on_disk(plan.src_dir(i), FileNameView(*plan.temp(i)), [&] { return *plan.temp(i); })) {
+			conflict(i, RenameStatus::TARGET_EXISTS, "Temporary file already exists !");
+		}
+	}
+
+	return conflicts;
+}
+
+// A rename with check_target false changes case only. Its target is then the source itself
+// on a file system that ignores case, but where case matters it may be another file: that
+// is a conflict, and a free name is checked as for any other rename. Returns PENDING to go on.
+inline RenameStatus CheckCaseChange(const std::wstring& src, const std::wstring& dst, std::string& error, bool& check_target) {
+	if (check_target || src == dst) return RenameStatus::PENDING;
+
+	switch (SameFile(src, dst, error)) {
+		case FsError::NONE:
+			return RenameStatus::PENDING;
+		case FsError::EXISTS:
+			error = "Target file already exists !";
+			return RenameStatus::TARGET_EXISTS;
+		case FsError::NOT_FOUND:
+			check_target = true;
+			return RenameStatus::PENDING;
+		default:
+			return RenameStatus::FAILED;
+	}
+}
+
+// One rename; never throws. With atomic set, the rename refuses to replace an existing
+// target in the same system call where the platform can (see RenameNoReplace);
+// otherwise, and where it cannot, source and target are checked first as the apply loop
+// always did. check_target is false for a change of case only (see CheckCaseChange).
+inline RenameStatus ApplyRename(const std::wstring& src, const std::wstring& dst, std::string& error, bool check_target = true, bool atomic = true) {
+	RenameStatus cased = CheckCaseChange(src, dst, error, check_target);
+	if (cased != RenameStatus::PENDING) return cased;
+
+	if (check_target && atomic) {
+		switch (RenameNoReplace(src, dst, error)) {
+			case FsError::NONE:
+				return RenameStatus::DONE;
+			case FsError::EXISTS:
+				error = "Target file already exists !";
+				return RenameStatus::TARGET_EXISTS;
+			case FsError::NOT_FOUND:
+			{
+				std::error_code ec;
+				if (!std::filesystem::exists(ToFsPath(src), ec)) {
+					error = "File doesn't exist !";
+					return RenameStatus::SOURCE_MISSING;
+				}
+				error = "Target directory doesn't exist !";
+				return RenameStatus::FAILED;
+			}
+			case FsError::OTHER:
+				return RenameStatus::FAILED;
+			case FsError::UNSUPPORTED:
+				break;
+		}
+	}
+
+	try {
+		std::filesystem::path src_path = ToFsPath(src);
+		std::filesystem::path dst_path = ToFsPath(dst);
+
+		if (!std::filesystem::exists(src_path)) {
+			error = "File doesn't exist !";
+			return RenameStatus::SOURCE_MISSING;
+		}
+		if (check_target && std::filesystem::exists(dst_path)) {
+			error = "Target file already exists !";
+			return RenameStatus::TARGET_EXISTS;
+		}
+
+		std::filesystem::rename(src_path, dst_path);
+		return RenameStatus::DONE;
+	} catch (const std::exception& e) {
+		error = e.what();
+	} catch (...) {
+		error = "Unknown Error !";
+	}
+	return RenameStatus::FAILED;
+}
+
+// ApplyRename on names in open directories: src and dst are still full paths, but only
+// their file names go to the system. Falls back to the full paths when either directory
+// is not open.
+inline RenameStatus ApplyRename(const DirHandle& src_dir, const std::wstring& src, const DirHandle& dst_dir, const std::wstring& dst, std::string& error, bool check_target = true, bool atomic = true) {
+	RenameStatus cased = CheckCaseChange(src, dst, error, check_target);
+	if (cased != RenameStatus::PENDING) return cased;
+
+	std::wstring_view src_leaf = FileNameView(src);
+	std::wstring_view dst_leaf = FileNameView(dst);
+	if (!src_dir.valid() || !dst_dir.valid() || src_leaf.empty() || dst_leaf.empty()) return ApplyRename(src, dst, error, check_target, atomic);
+
+	std::string src_name = WideToUtf8(src_leaf);
+	std::string dst_name = WideToUtf8(dst_leaf);
+	std::string ignored;
+
+	if (check_target && atomic) {
+		switch (RenameAt(src_dir, src_name, dst_dir, dst_name, true, error)) {
+			case FsError::NONE:
+				return RenameStatus::DONE;
+			case FsError::EXISTS:
+				error = "Target file already exists !";
+				return RenameStatus::TARGET_EXISTS;
+			case FsError::NOT_FOUND:
+				if (StatAt(src_dir, src_name, ignored) == FsError::NOT_FOUND) {
+					error = "File doesn't exist !";
+					return RenameStatus::SOURCE_MISSING;
+				}
+				error = "Target directory doesn't exist !";
+				return RenameStatus::FAILED;
+			case FsError::OTHER:
+				return RenameStatus::FAILED;
+			case FsError::UNSUPPORTED:
+				break;
+		}
+	}
+
+	if (StatAt(src_dir, src_name, ignored) == FsError::NOT_FOUND) {
+		error = "File doesn't exist !";
+		return RenameStatus::SOURCE_MISSING;
+	}
+	if (check_target && StatAt(dst_dir, dst_name, ignored) == FsError::NONE) {
+		error = "Target file already exists !";
+		return RenameStatus::TARGET_EXISTS;
+	}
+
+	switch (RenameAt(src_dir, src_name, dst_dir, dst_name, false, error)) {
+		case FsError::NONE:
+			return RenameStatus::DONE;
+		case FsError::NOT_FOUND:
+			error = "File doesn't exist !";
+			return RenameStatus::SOURCE_MISSING;
+		case FsError::UNSUPPORTED:
+			return ApplyRename(src, dst, error, check_target, false);
+		default:
+			return RenameStatus::FAILED;
+	}
+}
+
+// Directory handles for one shard of a plan. A directory that at least MIN_USES source
+// and target names of the shard live in is opened once, and its renames pass file names
+// only; the others keep full paths, where opening would cost more than it saves.
+// Handles close with the shard, so open descriptors stay bounded by the workers.
+class ShardDirs {
+public:
+	static constexpr size_t MIN_USES = 8;
+
+private:
+	std::unordered_map<uint32_t, DirHandle> open_;
+	DirHandle none_;
+
+public:
+	ShardDirs(const RenamePlan& plan, std::span<const RenamePlan::Step> steps) {
+		if constexpr (!HAS_DIR_HANDLES) return;
+
+		std::unordered_map<uint32_t, size_t> uses;
+		for (const RenamePlan::Step& st : steps) {
+			++uses[plan.step_src_dir(st)];
+			++uses[plan.step_dst_dir(st)];
+		}
+		for (const auto& [d, count] : uses) {
+			if (count < MIN_USES) continue;
+			DirHandle handle(plan.dir(d));
+			if (handle.valid()) open_.emplace(d, std::move(handle));
+		}
+	}
+
+	// The handle of directory d, or an invalid one when d is not open.
+	const DirHandle& get(uint32_t d) const {
+		auto it = open_.find(d);
+		return (it == open_.end()) ? none_ : it->second;
+	}
+};
+
+// The IO_URING backend of ExecuteRenamePlan. Every component of the plan is a lane that
+// runs its steps in order with one operation in flight, and up to opt.queue_depth lanes
+// run at once from the calling thread. Lanes are taken shard by shard; a shard keeps its
+// directory handles until its last lane ends.
+//
+// A rename that reports a missing file is followed by a statx of its source, to tell a
+// missing source from a missing target directory. A file system without
+// RENAME_NOREPLACE gets the checked rename, synchronously.
+//
+// With opt.stop_on_error, a failure stops new renames only: the operations already queued,
+// up to one per running lane, still complete and are reported.
+//
+// When the kernel refuses a submission, the operations it did not take are withdrawn and
+// the rest of the plan runs synchronously on this thread, lane by lane as before, so
+// every rename still gets its result and a broken cycle is still undone.
+//
+// Returns false, before anything is renamed, when no ring can be set up.
+inline bool ExecuteRenamePlanUring(const RenamePlan& plan, const RenameOptions& opt, std::vector<RenameResult>& results, RenameProgress& progress) {
+	using Phase = RenamePlan::Phase;
+	using Step = RenamePlan::Step;
+
+	IoUring ring(static_cast<unsigned>(std::clamp<size_t>(opt.queue_depth, 1, 4096)));
+	if (!ring.valid()) return false;
+
+	struct Lane {
+		size_t shard = 0;
+		const Step* pos = nullptr;
+		const Step* end = nullptr;
+		size_t in_temp = 0;
+		bool probing = false;			// waiting for the statx after ENOENT
+		bool no_replace = false;
+		int src_fd = IoUring::CWD;		// the operation in flight
+		int dst_fd = IoUring::CWD;
+		std::string src_name;
+		std::string dst_name;
+		StatxBuffer stx;
+	};
+
+	const size_t shards = plan.shard_count();
+	std::vector<Lane> lanes(ring.entries());
+	std::vector<uint32_t> free_lanes;
+	for (size_t l = lanes.size(); l-- > 0;) free_lanes.push_back(static_cast<uint32_t>(l));
+
+	std::vector<std::optional<ShardDirs>> shard_dirs(shards);
+	std::vector<uint32_t> shard_lanes(shards, 0);
+	size_t fill_shard = 0, fill_pos = 0;
+	size_t in_flight = 0;
+	bool stop = false;
+	bool sync = false;		// the ring failed; no more operations are queued to it
+
+	auto src_dir = [&](const Lane& lane) -> const DirHandle& { return shard_dirs[lane.shard]->get(plan.step_src_dir(*lane.pos)); };
+	auto dst_dir = [&](const Lane& lane) -> const DirHandle& { return shard_dirs[lane.shard]->get(plan.step_dst_dir(*lane.pos)); };
+
+	// Records the outcome of the lane's current step and moves past it.
+	auto settle = [&](Lane& lane, RenameStatus status) {
+		const Step& st = *lane.pos;
+		RenameResult& r = results[st.op];
+		r.status = status;
+
+		if (st.phase == Phase::TO_TEMP && status == RenameStatus::DONE) {
+			r.status = RenameStatus::PENDING;
+			++lane.in_temp;
+		} else {
+			if (st.phase == Phase::FROM_TEMP && status != RenameStatus::DONE) {
+				std::string ignored;
+				ApplyRename(src_dir(lane), plan.step_src(st), src_dir(lane), plan.src(st.op), ignored, true, true);
+			}
+			if (status != RenameStatus::DONE) {
+				progress.failed.fetch_add(1, std::memory_order_relaxed);
+				if (opt.stop_on_error) stop = true;
+			}
+			progress.done.fetch_add(1, std::memory_order_relaxed);
+		}
+		++lane.pos;
+	};
+
+	// Runs the lane up to its next operation and queues it, or ends the lane.
+	auto advance = [&](uint32_t id) {
+		Lane& lane = lanes[id];
+		while (lane.pos != lane.end) {
+			const Step& st = *lane.pos;
+			const uint32_t i = st.op;
+			RenameResult& r = results[i];
+
+			if (st.phase == Phase::FROM_TEMP) {
+				if (r.status != RenameStatus::PENDING) {	// the first half did not happen
+					++lane.pos;
+					continue;
+				}
+				--lane.in_temp;
+			}
+
+			if (lane.in_temp == 0 && st.phase != Phase::FROM_TEMP && stop) {
+				r.status = RenameStatus::SKIPPED;
+				r.error = "Skipped after an earlier failure !";
+				progress.done.fetch_add(1, std::memory_order_relaxed);
+				++lane.pos;
+				continue;
+			}
+			if (st.phase == Phase::WHOLE && plan.unchanged(i)) {
+				r.status = RenameStatus::DONE;
+				progress.done.fetch_add(1, std::memory_order_relaxed);
+				++lane.pos;
+				continue;
+			}
+
+			const std::wstring& src = plan.step_src(st);
+			const std::wstring& dst = plan.step_dst(st);
+			const DirHandle& sd = src_dir(lane);
+			const DirHandle& dd = dst_dir(lane);
+			std::wstring_view src_leaf = FileNameView(src);
+			std::wstring_view dst_leaf = FileNameView(dst);
+			bool relative = sd.valid() && dd.valid() && !src_leaf.empty() && !dst_leaf.empty();
+
+			lane.src_fd = relative ? sd.native() : IoUring::CWD;
+			lane.dst_fd = relative ? dd.native() : IoUring::CWD;
+			lane.src_name = WideToUtf8(relative ? src_leaf : std::wstring_view(src));
+			lane.dst_name = WideToUtf8(relative ? dst_leaf : std::wstring_view(dst));
+			lane.no_replace = plan.src_id(i) != plan.dst_id(i);
+
+			RenameStatus cased = CheckCaseChange(src, dst, r.error, lane.no_replace);
+			if (cased != RenameStatus::PENDING) {
+				settle(lane, cased);
+				continue;
+			}
+
+			if (!sync && ring.prep_rename(id, lane.src_fd, lane.src_name.c_str(), lane.dst_fd, lane.dst_name.c_str(), lane.no_replace ? IoUring::NO_REPLACE : 0)) {
+				++in_flight;
+				return;
+			}
+			settle(lane, ApplyRename(sd, src, dd, dst, r.error, lane.no_replace, true));
+		}
+
+		if (--shard_lanes[lane.shard] == 0 && lane.shard < fill_shard) shard_dirs[lane.shard].reset();
+		free_lanes.push_back(id);
+	};
+
+	auto complete = [&](uint32_t id, int res) {
+		Lane& lane = lanes[id];
+		std::string& error = results[lane.pos->op].error;
+		RenameStatus status = RenameStatus::FAILED;
+
+		if (lane.probing) {
+			lane.probing = false;
+			if (res == -ENOENT) {
+				error = "File doesn't exist !";
+				status = RenameStatus::SOURCE_MISSING;
+			} else {
+				error = "Target directory doesn't exist !";
+			}
+		} else if (res == 0) {
+			status = RenameStatus::DONE;
+		} else if (res == -EEXIST) {
+			error = "Target file already exists !";
+			status = RenameStatus::TARGET_EXISTS;
+		} else if (res == -ENOENT && !sync && ring.prep_statx(id, lane.src_fd, lane.src_name.c_str(), IoUring::NO_FOLLOW, &lane.stx)) {
+			lane.probing = true;
+			++in_flight;
+			return;
+		} else if (res == -ENOENT) {
+			status = ApplyRename(src_dir(lane), plan.step_src(*lane.pos), dst_dir(lane), plan.step_dst(*lane.pos), error, lane.no_replace, true);
+		} else if (lane.no_replace && (res == -EINVAL || res == -EOPNOTSUPP || res == -ENOSYS)) {
+			status = ApplyRename(src_dir(lane), plan.step_src(*lane.pos), dst_dir(lane), plan.step_dst(*lane.pos), error, true, false);
+		} else {
+			error = std::generic_category().message(-res);
+		}
+
+		settle(lane, status);
+		advance(id);
+	};
+
+	// Starts a lane on the next component, if there is one.
+	auto start_lane = [&]() -> bool {
+		if (fill_shard == shards) return false;
+
+		std::span<const Step> steps = plan.shard(fill_shard);
+		if (fill_pos == 0) shard_dirs[fill_shard].emplace(plan, steps);
+
+		size_t end = fill_pos + 1;
+		while (end < steps.size() && !steps[end].first) ++end;
+
+		uint32_t id = free_lanes.back();
+		free_lanes.pop_back();
+		Lane& lane = lanes[id];
+		lane.shard = fill_shard;
+		lane.pos = steps.data() + fill_pos;
+		lane.end = steps.data() + end;
+		lane.in_temp = 0;
+		lane.probing = false;
+		++shard_lanes[fill_shard];
+
+		fill_pos = end;
+		if (fill_pos == steps.size()) {
+			++fill_shard;
+			fill_pos = 0;
+		}
+
+		advance(id);
+		return true;
+	};
+
+	while (true) {
+		while (!free_lanes.empty() && start_lane()) {}
+		if (in_flight == 0) break;
+
+		if (!ring.submit(1)) {
+			if (!sync) {
+				// Run the withdrawn operations here instead; a withdrawn statx reruns its rename,
+				// which fails again and tells the same.
+				sync = true;
+				ring.withdraw([&](uint64_t id) {
+					--in_flight;
+					Lane& lane = lanes[static_cast<uint32_t>(id)];
+					lane.probing = false;
+					settle(lane, ApplyRename(src_dir(lane), plan.step_src(*lane.pos), dst_dir(lane), plan.step_dst(*lane.pos), results[lane.pos->op].error, lane.no_replace, true));
+					advance(static_cast<uint32_t>(id));
+				});
+			} else {
+				std::this_thread::yield();		// the taken operations complete without waiting in the kernel
+			}
+		}
+		ring.reap([&](uint64_t id, int res) {
+			--in_flight;
+			complete(static_cast<uint32_t>(id), res);
+		});
+	}
+	return true;
+}
+
+// Runs plan shard by shard on up to opt.concurrency workers; results[i] receives the
+// outcome of rename i. Returns the index of the first failed rename in plan order, or
+// plan.size() when all of them succeeded. Directories a shard renames in often are
+// opened once for the shard (see ShardDirs). With opt.backend IO_URING the renames are
+// queued to io_uring instead (see ExecuteRenamePlanUring).
+//
+// A stop request never leaves a file at a temporary name: the shard finishes the cycle it
+// is in first. If the second half of a broken cycle fails, the file is moved back to its
+// original name when that is still free.
+inline size_t ExecuteRenamePlan(const RenamePlan& plan, const RenameOptions& opt, std::vector<RenameResult>& results, RenameProgress& progress) {
+	using Phase = RenamePlan::Phase;
+
+	const size_t n = plan.size();
+	results.assign(n, RenameResult());
+	progress.reset(n);
+
+	std::atomic<bool> stop{ false };
+
+	auto run_shard = [&](size_t k) {
+		ShardDirs dirs(plan, plan.shard(k));
+		size_t in_temp = 0;
+		for (const RenamePlan::Step& st : plan.shard(k)) {
+			const uint32_t i = st.op;
+			RenameResult& r = results[i];
+
+			if (st.phase == Phase::FROM_TEMP) {
+				if (r.status != RenameStatus::PENDING) continue;	// the first half did not happen
+				--in_temp;
+			}
+
+			if (in_temp == 0 && st.phase != Phase::FROM_TEMP && stop.load(std::memory_order_relaxed)) {
+				r.status = RenameStatus::SKIPPED;
+				r.error = "Skipped after an earlier failure !";
+			} else if (st.phase == Phase::WHOLE && plan.unchanged(i)) {
+				r.status = RenameStatus::DONE;
+			} else {
+				const DirHandle& src_dir = dirs.get(plan.step_src_dir(st));
+				r.status = ApplyRename(src_dir, plan.step_src(st), dirs.get(plan.step_dst_dir(st)), plan.step_dst(st), r.error, plan.src_id(i) != plan.dst_id(i), opt.atomic_rename);
+
+				if (st.phase == Phase::TO_TEMP && r.status == RenameStatus::DONE) {
+					r.status = RenameStatus::PENDING;
+					++in_temp;
+					continue;
+				}
+				if (st.phase == Phase::FROM_TEMP && r.status != RenameStatus::DONE) {
+					std::string ignored;
+					ApplyRename(src_dir, plan.step_src(st), src_dir, plan.src(i), ignored, true, opt.atomic_rename);
+				}
+				if (r.status != RenameStatus::DONE) {
+					progress.failed.fetch_add(1, std::memory_order_relaxed);
+					if (opt.stop_on_error) stop.store(true, std::memory_order_relaxed);
+				}
+			}
+			progress.done.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
+	const size_t shards = plan.shard_count();
+	size_t workers = opt.concurrency ? opt.concurrency : (std::max)(1u, std::thread::hardware_concurrency());
+	workers = (std::min)(workers, shards);
+
+	bool queued = opt.backend == RenameBackend::IO_URING && opt.atomic_rename && ExecuteRenamePlanUring(plan, opt, results, progress);
+	if (!queued) {
+		if (workers <= 1) {
+			for (size_t k = 0; k < shards; ++k) run_shard(k);
+		} else {
+			aop::WorkStealingPool pool(workers);
+			pool.parallel_for(0, shards, 1, [&](size_t first, size_t last) {
+				for (size_t k = first; k < last; ++k) run_shard(k);
+			});
+		}
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		if (results[i].status != RenameStatus::DONE && results[i].status != RenameStatus::SKIPPED) return i;
+	}
+	return n;
+}
+
+} // namespace pt
+
+#endif // !_RENAME_PLAN_HPP
@@ -459,6 +459,12 @@ namespace ui {
 						break;
 					}
 
+					case ID_FILE_OPEN_FOLDER:
+					{
+						HandleFolderOpen(hwnd);
+						break;
+					}
+
 					case ID_FILE_CLEAR:
 					{
 						if (!shared_data::pt_.reset_selected_file()) {
@@ -649,6 +655,23 @@ namespace ui {
 						UpdateExpressionDisplay();
 						break;
 					}
+					case ID_EDIT_PARSE:
+					{
+						std::wstring inputStr;
+						if (ShowInputBox(hwnd, GetStrings().labelInput, GetStrings().exprParse, inputStr)) {
+							try {
+								if (!shared_data::pt_.set_expr_text(inputStr)) {
+									GuardUiOp(hwnd, false);
+									break;
+								}
+								UpdateExpressionDisplay();
+							} catch (const std::exception& e) {
+								std::string what = e.what();
+								MessageBoxW(hwnd, std::wstring(what.begin(), what.end()).c_str(), L"Error", MB_OK | MB_ICONERROR | MB_TOPMOST);
+							}
+						}
+						break;
+					}
 
 				}
 				return 0;
@@ -11,6 +11,7 @@ namespace ui {
 	constexpr int ID_LISTVIEW = 1003;
 	constexpr int ID_OPTIONS_SUBMIT = 1004;
 	constexpr int ID_OPTIONS_SUBMIT_AUTO = 1005;
+	constexpr int ID_FILE_OPEN_FOLDER = 1006;
 
 	constexpr int ID_OPTIONS_EXIT = 9002;
 	constexpr int ID_OPTIONS_HELP = 9008;
@@ -28,6 +29,7 @@ namespace ui {
 	constexpr int ID_EDIT_PUSH_DEL = 2011;
 	constexpr int ID_EDIT_PUSH_NUM_FORMAT = 2012;
 	constexpr int ID_EDIT_CLEAR = 2013;
+	constexpr int ID_EDIT_PARSE = 2014;
 
 	constexpr int ID_LANG_EN = 9003;
 	constexpr int ID_LANG_ZH = 9004;
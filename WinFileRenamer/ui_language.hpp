@@ -13,6 +13,7 @@ namespace ui {
 		const wchar_t* optionMenu;
 
 		const wchar_t* fileOpen;
+		const wchar_t* fileOpenFolder;
 		const wchar_t* fileClear;
 		const wchar_t* fileSubmit;
 		const wchar_t* fileSubmitAuto;
@@ -38,6 +39,7 @@ namespace ui {
 
 		const wchar_t* exprDel;
 		const wchar_t* exprClear;
+		const wchar_t* exprParse;
 
 		const wchar_t* optLang;
 		const wchar_t* optExit;
@@ -60,12 +62,12 @@ namespace ui {
 			ID_LANG_EN, L"English",
 			{
 				L"File", L"Expression", L"Options",
-				L"Open", L"Clear", L"Submit Rename", L"Auto Match Subtitles",
+				L"Open", L"Open Folder...", L"Clear", L"Submit Rename", L"Auto Match Subtitles",
 				L"Constants", L"Push String...", L"Push Number...", L"Push Minimum Num Length...",
 				L"Variables", L"Push Index", L"Push OriginFileName",
 				L"Operators", L"Add (+)", L"Sub (-)", L"Mul (*)", L"Div (/)",
 				L"Brackets", L"Left Bracket (", L"Right Bracket )",
-				L"Delete Last", L"Clear Expression",
+				L"Delete Last", L"Clear Expression", L"Enter Expression...",
 				L"Language", L"Exit", L"Help",
 				L"Selected Files", L"Expression Preview", L"Input", L"File Path"
 			}
@@ -74,12 +76,12 @@ namespace ui {
 			ID_LANG_ZH, L"中文(简体)",
 			{
 				L"文件", L"表达式", L"选项",
-				L"打开", L"清空", L"应用重命名", L"自动匹配字幕名",
+				L"打开", L"打开文件夹...", L"清空", L"应用重命名", L"自动匹配字幕名",
 				L"常量", L"添加字符串...", L"添加数字...", L"添加最小数字格式...",
 				L"变量", L"添加序号", L"添加原始文件名",
 				L"运算符", L"加 (+)", L"减 (-)", L"乘 (*)", L"除 (/)",
 				L"括号", L"左括号 (", L"右括号 )",
-				L"删除上一个", L"清空表达式",
+				L"删除上一个", L"清空表达式", L"输入表达式...",
 				L"语言", L"退出", L"帮助",
 				L"已选文件", L"表达式预览", L"输入框", L"文件路径"
 			}
@@ -88,12 +90,12 @@ namespace ui {
 			ID_LANG_ZH_TW, L"中文(繁體)",
 			{
 				L"檔案", L"運算式", L"選項",
-				L"開啟", L"清空", L"套用重新命名", L"自動配對字幕名",
+				L"開啟", L"開啟資料夾...", L"清空", L"套用重新命名", L"自動配對字幕名",
 				L"常數", L"加入字串...", L"加入數字...", L"加入最小數字格式...",
 				L"變數", L"加入序號", L"加入原始檔名",
 				L"運算子", L"加 (+)", L"減 (-)", L"乘 (*)", L"除 (/)",
 				L"括號", L"左括號 (", L"右括號 )",
-				L"刪除上一個", L"清空運算式",
+				L"刪除上一個", L"清空運算式", L"輸入運算式...",
 				L"語言", L"退出", L"幫助",
 				L"已選檔案", L"運算式預覽", L"輸入框", L"檔案路徑"
 			}
@@ -102,12 +104,12 @@ namespace ui {
 			ID_LANG_JA, L"日本語",
 			{
 				L"ファイル", L"式", L"オプション",
-				L"開く", L"クリア", L"名前変更を適用", L"字幕を自動マッチ",
+				L"開く", L"フォルダーを開く...", L"クリア", L"名前変更を適用", L"字幕を自動マッチ",
 				L"定数", L"文字列を追加...", L"数値を追加...", L"最小数値形式を追加...",
 				L"変数", L"連番を追加", L"元のファイル名を追加",
 				L"演算子", L"加算 (+)", L"減算 (-)", L"乗算 (*)", L"除算 (/)",
 				L"括弧", L"左括弧 (", L"右括弧 )",
-				L"最後を削除", L"式をクリア",
+				L"最後を削除", L"式をクリア", L"式を入力...",
 				L"言語", L"終了", L"ヘルプ",
 				L"選択されたファイル", L"式のプレビュー", L"入力", L"ファイルパス"
 			}
@@ -116,12 +118,12 @@ namespace ui {
 			ID_LANG_RU, L"Русский",
 			{
 				L"Файл", L"Выражение", L"Настройки",
-				L"Открыть", L"Очистить", L"Применить", L"Авто-подбор субтитров",
+				L"Открыть", L"Открыть папку...", L"Очистить", L"Применить", L"Авто-подбор субтитров",
 				L"Константы", L"Добавить строку...", L"Добавить число...", L"Добавить мин. длину числа...",
 				L"Переменные", L"Добавить индекс", L"Добавить исх. имя файла",
 				L"Операторы", L"Сложение (+)", L"Вычитание (-)", L"Умножение (*)", L"Деление (/)",
 				L"Скобки", L"Левая скобка (", L"Правая скобка )",
-				L"Удалить последнее", L"Очистить выражение",
+				L"Удалить последнее", L"Очистить выражение", L"Ввести выражение...",
 				L"Язык", L"Выход", L"Помощь",
 				L"Выбранные файлы", L"Предпросмотр выражения", L"Ввод", L"Путь к файлу"
 			}
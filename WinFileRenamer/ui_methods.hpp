@@ -4,8 +4,10 @@
 #include <Windows.h>
 #include <CommCtrl.h>
 #include <commdlg.h>
+#include <ShlObj.h>
 #include <string>
 #include <memory>
+#include <vector>
 #include <stdexcept>
 #include "shared_data.hpp"
 #include "ui_constants.hpp"
@@ -51,6 +53,7 @@ namespace ui {
 
 		HMENU hFileMenu = CreatePopupMenu();
 		AppendMenu(hFileMenu, MF_STRING, ID_FILE_OPEN, s.fileOpen);
+		AppendMenu(hFileMenu, MF_STRING, ID_FILE_OPEN_FOLDER, s.fileOpenFolder);
 		AppendMenu(hFileMenu, MF_STRING, ID_FILE_CLEAR, s.fileClear);
 		AppendMenu(hFileMenu, MF_SEPARATOR, NULL, NULL);
 		AppendMenu(hFileMenu, MF_STRING, ID_OPTIONS_SUBMIT, s.fileSubmit);
@@ -85,6 +88,8 @@ namespace ui {
 		AppendMenu(hEditMenu, MF_STRING, ID_EDIT_PUSH_DEL, s.exprDel);
 		AppendMenu(hEditMenu, MF_SEPARATOR, NULL, NULL);
 		AppendMenu(hEditMenu, MF_STRING, ID_EDIT_CLEAR, s.exprClear);
+		AppendMenu(hEditMenu, MF_SEPARATOR, NULL, NULL);
+		AppendMenu(hEditMenu, MF_STRING, ID_EDIT_PARSE, s.exprParse);
 
 		HMENU hLangMenu = CreatePopupMenu();
 		for (size_t i = 0; i < supported_languages.size(); ++i) {
@@ -135,31 +140,53 @@ namespace ui {
 		}
 	}
 
-	// Helper function to add a file path to the list view.
-	// Returns true on success. If returns false, UI should not change.
-	inline bool AddFileToList(HWND hwnd, const std::wstring& filePath) {
-		if (!hListView_) return false;
+	// Helper function to add file paths to the list view.
+	// The list view takes all of them first, the backend then takes them in one call, and
+	// whatever it refuses is removed again, so UI and backend stay consistent.
+	inline void AddFilesToList(HWND hwnd, std::vector<std::wstring>&& paths) {
+		if (!hListView_ || paths.empty()) return;
+
+		const int first = ListView_GetItemCount(hListView_);
+		const int count = static_cast<int>(paths.size());
+		SendMessage(hListView_, WM_SETREDRAW, FALSE, 0);
+		ListView_SetItemCount(hListView_, first + count);
+
+		int inserted = 0;
+		for (; inserted < count; ++inserted) {
+			LVITEMW lvi = { 0 };
+			lvi.mask = LVIF_TEXT;
+			lvi.pszText = const_cast<LPWSTR>(paths[inserted].c_str()); // Safe cast for insertion
+			lvi.iItem = first + inserted; // Insert at the end
+			lvi.iSubItem = 0;
+			if (ListView_InsertItem(hListView_, &lvi) < 0) break;
+		}
+
+		size_t duplicates = 0;
+		bool busy = false;
+		if (inserted < count) {
+			while (inserted > 0) ListView_DeleteItem(hListView_, first + --inserted);
+		} else {
+			std::vector<pt::PushStatus> status = shared_data::pt_.push_filepaths(std::move(paths));
+			for (int i = count; i-- > 0;) {
+				if (status[i] == pt::PushStatus::ADDED) continue;
+				ListView_DeleteItem(hListView_, first + i);
+				if (status[i] == pt::PushStatus::BUSY) busy = true;
+				else ++duplicates;
+			}
+		}
 
-		LVITEMW lvi = { 0 };
-		lvi.mask = LVIF_TEXT;
-		lvi.pszText = const_cast<LPWSTR>(filePath.c_str()); // Safe cast for insertion
-		lvi.iItem = ListView_GetItemCount(hListView_); // Insert at the end
-		lvi.iSubItem = 0;
+		SendMessage(hListView_, WM_SETREDRAW, TRUE, 0);
+		InvalidateRect(hListView_, NULL, TRUE);
 
-		int inserted = ListView_InsertItem(hListView_, &lvi);
-		if (inserted < 0) {
+		if (inserted < count) {
 			MessageBeep(MB_ICONWARNING);
 			if (hwnd) MessageBoxW(hwnd, L"Failed to insert item into list view.", L"Warning", MB_OK | MB_ICONWARNING | MB_TOPMOST);
-			return false;
-		}
-
-		// Keep UI/backend consistent: if backend rejects, rollback the UI insertion.
-		if (!shared_data::pt_.push_filepath(filePath)) {
-			ListView_DeleteItem(hListView_, inserted);
-			return GuardUiOp(hwnd, false);
+		} else if (busy) {
+			GuardUiOp(hwnd, false);
+		} else if (duplicates) {
+			std::wstring msg = std::to_wstring(duplicates) + L" file(s) already in the list were skipped.";
+			MessageBoxW(hwnd, msg.c_str(), L"Info", MB_OK | MB_ICONINFORMATION | MB_TOPMOST);
 		}
-
-		return true;
 	}
 
 	// Helper function to handle the "Open File" dialog logic
@@ -189,6 +216,7 @@ namespace ui {
 		ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST | OFN_ALLOWMULTISELECT | OFN_EXPLORER;
 
 		if (GetOpenFileNameW(&ofn) == TRUE) {
+			std::vector<std::wstring> paths;
 			wchar_t* p = szFile.get();
 			std::wstring dir = p; // First string is the directory
 
@@ -197,19 +225,102 @@ namespace ui {
 
 			if (*p == 0) {
 				// Only one file was selected. 'dir' holds the full path.
-				AddFileToList(hwnd, dir);
+				paths.push_back(std::move(dir));
 			} else {
 				// Multiple files were selected.
 				// Loop through the subsequent null-terminated file names.
 				while (*p) {
 					std::wstring file = p;
-					std::wstring fullPath = dir + L"\\" + file;
-					AddFileToList(hwnd, fullPath);
+					paths.push_back(dir + L"\\" + file);
 
 					// Move to the next file name
 					p += file.length() + 1;
 				}
 			}
+
+			AddFilesToList(hwnd, std::move(paths));
+		}
+	}
+
+
+	// Helper function to handle the "Open Folder" logic.
+	// Adds every file below the chosen folder, sorted by folder and then by name. The scan
+	// goes straight into the file table, and the list view is filled from there.
+	inline void HandleFolderOpen(HWND hwnd) {
+		// Reject file selection while background rename is running.
+		if (shared_data::pt_.get_state() == pt::ProcessThread::STATE_ONGOING) {
+			GuardUiOp(hwnd, false);
+			return;
+		}
+
+		// The new dialog style needs COM on this thread.
+		HRESULT co = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+
+		BROWSEINFOW bi = { 0 };
+		bi.hwndOwner = hwnd;
+		bi.lpszTitle = GetStrings().fileOpenFolder;
+		bi.ulFlags = BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
+
+		std::wstring root;
+		if (PIDLIST_ABSOLUTE pidl = SHBrowseForFolderW(&bi)) {
+			constexpr DWORD PATH_BUFFER = 32767;
+			std::unique_ptr<wchar_t[]> szPath = std::make_unique<wchar_t[]>(PATH_BUFFER);
+			if (SHGetPathFromIDListEx(pidl, szPath.get(), PATH_BUFFER, GPFIDL_DEFAULT)) root = szPath.get();
+			CoTaskMemFree(pidl);
+		}
+		if (SUCCEEDED(co)) CoUninitialize();
+		if (root.empty()) return;
+
+		if (!hListView_) return;
+
+		HCURSOR hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+
+		// The list view holds one item per file of the table, in the same order.
+		const int first = ListView_GetItemCount(hListView_);
+		pt::ScanStats stats;
+		size_t duplicates = 0;
+		if (!shared_data::pt_.push_directory(root, pt::ScanOptions{}, stats, duplicates)) {
+			SetCursor(hOldCursor);
+			GuardUiOp(hwnd, false);
+			return;
+		}
+
+		SendMessage(hListView_, WM_SETREDRAW, FALSE, 0);
+		ListView_SetItemCount(hListView_, first + static_cast<int>(stats.files - duplicates));
+
+		int inserted = 0;
+		bool failed = false;
+		shared_data::pt_.for_each_file(static_cast<size_t>(first), [&](const std::wstring& path) {
+			if (failed) return;
+			LVITEMW lvi = { 0 };
+			lvi.mask = LVIF_TEXT;
+			lvi.pszText = const_cast<LPWSTR>(path.c_str()); // Safe cast for insertion
+			lvi.iItem = first + inserted; // Insert at the end
+			lvi.iSubItem = 0;
+			if (ListView_InsertItem(hListView_, &lvi) < 0) failed = true;
+			else ++inserted;
+		});
+		if (failed) {
+			while (inserted > 0) ListView_DeleteItem(hListView_, first + --inserted);
+			shared_data::pt_.truncate_files(static_cast<size_t>(first));
+		}
+
+		SendMessage(hListView_, WM_SETREDRAW, TRUE, 0);
+		InvalidateRect(hListView_, NULL, TRUE);
+		SetCursor(hOldCursor);
+
+		if (failed) {
+			MessageBeep(MB_ICONWARNING);
+			MessageBoxW(hwnd, L"Failed to insert item into list view.", L"Warning", MB_OK | MB_ICONWARNING | MB_TOPMOST);
+			return;
+		}
+		if (duplicates) {
+			std::wstring msg = std::to_wstring(duplicates) + L" file(s) already in the list were skipped.";
+			MessageBoxW(hwnd, msg.c_str(), L"Info", MB_OK | MB_ICONINFORMATION | MB_TOPMOST);
+		}
+		if (stats.errors) {
+			std::wstring msg = std::to_wstring(stats.errors) + L" folder(s) could not be read.";
+			MessageBoxW(hwnd, msg.c_str(), L"Warning", MB_OK | MB_ICONWARNING | MB_TOPMOST);
 		}
 	}
 
@@ -9,8 +9,6 @@ inline void update_main_ui_LOOP(ui::RegisterReturn rrt) {
 	HWND hwnd = rrt.hwnd;
 	(void)wndclass;
 
-	calc::warmup_operator_tables();
-
 	if (!shared_data::sts_.stop_requested()) {
 
 		ShowWindow(hwnd, SW_SHOWDEFAULT);
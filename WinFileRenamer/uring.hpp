@@ -0,0 +1,260 @@
+﻿#ifndef _URING_HPP
+#define _URING_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define WFR_HAS_IO_URING 1
+#else
+#define WFR_HAS_IO_URING 0
+#endif
+
+namespace pt {
+
+inline constexpr bool HAS_IO_URING = WFR_HAS_IO_URING;
+
+// Room for the struct statx an IORING_OP_STATX writes.
+struct StatxBuffer {
+	alignas(8) unsigned char bytes[256];
+};
+
+// Minimal io_uring submission and completion rings over the raw system calls, for the
+// file operations the rename executor queues: renameat and statx. Only one thread may use
+// a ring. Where io_uring is missing, disabled (kernel.io_uring_disabled, container
+// seccomp filters) or lacks those operations, valid() is false and the caller runs its
+// synchronous path instead.
+class IoUring {
+public:
+	// Where a path is not relative to an open directory.
+	static constexpr int CWD = -100;				// AT_FDCWD
+	static constexpr unsigned NO_REPLACE = 1;		// RENAME_NOREPLACE, for prep_rename
+	static constexpr unsigned NO_FOLLOW = 0x100;	// AT_SYMLINK_NOFOLLOW, for prep_statx
+
+#if WFR_HAS_IO_URING
+private:
+	int fd_ = -1;
+	unsigned entries_ = 0;
+	unsigned queued_ = 0;		// prepared, not yet handed to the kernel
+
+	void* sq_ptr_ = nullptr;
+	void* cq_ptr_ = nullptr;
+	size_t sq_len_ = 0;
+	size_t cq_len_ = 0;
+	io_uring_sqe* sqes_ = nullptr;
+	size_t sqes_len_ = 0;
+
+	unsigned* sq_head_ = nullptr;
+	unsigned* sq_tail_ = nullptr;
+	unsigned sq_mask_ = 0;
+	unsigned* sq_array_ = nullptr;
+	unsigned* cq_head_ = nullptr;
+	unsigned* cq_tail_ = nullptr;
+	unsigned cq_mask_ = 0;
+	io_uring_cqe* cqes_ = nullptr;
+
+	static unsigned load_acquire(unsigned* p) { return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire); }
+	static void store_release(unsigned* p, unsigned v) { std::atomic_ref<unsigned>(*p).store(v, std::memory_order_release); }
+
+	template <typename T>
+	static T* at(void* base, uint32_t off) { return reinterpret_cast<T*>(static_cast<char*>(base) + off); }
+
+	bool supports(std::initializer_list<int> ops) const {
+		std::vector<unsigned char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+		auto* probe = reinterpret_cast<io_uring_probe*>(buf.data());
+		if (::syscall(SYS_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+		for (int op : ops) {
+			if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+		}
+		return true;
+	}
+
+	void release() {
+		if (sqes_) ::munmap(sqes_, sqes_len_);
+		if (cq_ptr_ && cq_ptr_ != sq_ptr_) ::munmap(cq_ptr_, cq_len_);
+		if (sq_ptr_) ::munmap(sq_ptr_, sq_len_);
+		if (fd_ >= 0) ::close(fd_);
+		fd_ = -1;
+		sq_ptr_ = cq_ptr_ = nullptr;
+		sqes_ = nullptr;
+	}
+
+	void setup(unsigned entries) {
+		io_uring_params p;
+		std::memset(&p, 0, sizeof(p));
+		p.flags = IORING_SETUP_CLAMP;
+
+		fd_ = static_cast<int>(::syscall(SYS_io_uring_setup, entries, &p));
+		if (fd_ < 0) return;
+
+		sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP) sq_len_ = cq_len_ = (std::max)(sq_len_, cq_len_);
+
+		sq_ptr_ = ::mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+		if (sq_ptr_ == MAP_FAILED) {
+			sq_ptr_ = nullptr;
+			return release();
+		}
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			cq_ptr_ = sq_ptr_;
+		} else {
+			cq_ptr_ = ::mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+			if (cq_ptr_ == MAP_FAILED) {
+				cq_ptr_ = nullptr;
+				return release();
+			}
+		}
+		sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+		void* sqes = ::mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED) return release();
+		sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+		sq_head_ = at<unsigned>(sq_ptr_, p.sq_off.head);
+		sq_tail_ = at<unsigned>(sq_ptr_, p.sq_off.tail);
+		sq_mask_ = *at<unsigned>(sq_ptr_, p.sq_off.ring_mask);
+		sq_array_ = at<unsigned>(sq_ptr_, p.sq_off.array);
+		cq_head_ = at<unsigned>(cq_ptr_, p.cq_off.head);
+		cq_tail_ = at<unsigned>(cq_ptr_, p.cq_off.tail);
+		cq_mask_ = *at<unsigned>(cq_ptr_, p.cq_off.ring_mask);
+		cqes_ = at<io_uring_cqe>(cq_ptr_, p.cq_off.cqes);
+		entries_ = p.sq_entries;
+
+		if (!supports({ IORING_OP_RENAMEAT, IORING_OP_STATX })) release();
+	}
+
+	io_uring_sqe* next_sqe(uint64_t user_data) {
+		unsigned tail = *sq_tail_;
+		if (tail - load_acquire(sq_head_) >= entries_) return nullptr;
+
+		unsigned idx = tail & sq_mask_;
+		io_uring_sqe* sqe = &sqes_[idx];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqe->user_data = user_data;
+		sq_array_[idx] = idx;
+		store_release(sq_tail_, tail + 1);
+		++queued_;
+		return sqe;
+	}
+
+public:
+	explicit IoUring(unsigned entries) { setup(entries); }
+	~IoUring() { release(); }
+
+	bool valid() const { return fd_ >= 0; }
+	unsigned entries() const { return entries_; }
+
+	// Queues renameat2(src_dir, src, dst_dir, dst, flags); the paths must stay alive until
+	// its completion. False when the submission ring is full.
+	bool prep_rename(uint64_t user_data, int src_dir, const char* src, int dst_dir, const char* dst, unsigned flags) {
+		io_uring_sqe* sqe = next_sqe(user_data);
+		if (!sqe) return false;
+		sqe->opcode = IORING_OP_RENAMEAT;
+		sqe->fd = src_dir;
+		sqe->addr = reinterpret_cast<uint64_t>(src);
+		sqe->len = static_cast<uint32_t>(dst_dir);
+		sqe->addr2 = reinterpret_cast<uint64_t>(dst);
+		sqe->rename_flags = flags;
+		return true;
+	}
+
+	// Queues statx(dir, path) into out, which must stay alive until its completion.
+	bool prep_statx(uint64_t user_data, int dir, const char* path, unsigned flags, StatxBuffer* out) {
+		static_assert(sizeof(struct statx) <= sizeof(StatxBuffer));
+		io_uring_sqe* sqe = next_sqe(user_data);
+		if (!sqe) return false;
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = dir;
+		sqe->addr = reinterpret_cast<uint64_t>(path);
+		sqe->len = 0;
+		sqe->addr2 = reinterpret_cast<uint64_t>(out);
+		sqe->statx_flags = flags;
+		return true;
+	}
+
+	// Hands the queued operations to the kernel and waits for at least wait_nr completions.
+	// Returns false on an error other than an interrupted wait.
+	bool submit(unsigned wait_nr) {
+		while (true) {
+			long ret = ::syscall(SYS_io_uring_enter, fd_, queued_, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+			if (ret >= 0) {
+				queued_ -= static_cast<unsigned>(ret);
+				return true;
+			}
+			if (errno != EINTR) return false;
+		}
+	}
+
+	// Takes back the operations queued but not handed to the kernel, as after a failed
+	// submit, and calls fn(user_data) for each: they will never run. Operations the kernel
+	// already took still complete. Returns the number taken back.
+	template <typename Fn>
+	unsigned withdraw(Fn&& fn) {
+		unsigned head = load_acquire(sq_head_);
+		unsigned tail = *sq_tail_;
+		std::vector<uint64_t> ids;
+		for (unsigned t = head; t != tail; ++t) ids.push_back(sqes_[sq_array_[t & sq_mask_]].user_data);
+		store_release(sq_tail_, head);
+		queued_ = 0;
+
+		for (uint64_t id : ids) fn(id);
+		return static_cast<unsigned>(ids.size());
+	}
+
+	// Calls fn(user_data, res) for every completion available; res is the operation's
+	// return value, -errno on failure. Returns the number of completions.
+	template <typename Fn>
+	unsigned reap(Fn&& fn) {
+		unsigned head = *cq_head_;
+		unsigned tail = load_acquire(cq_tail_);
+		unsigned count = 0;
+		for (; head != tail; ++head, ++count) {
+			const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+			uint64_t user_data = cqe.user_data;
+			int res = cqe.res;
+			store_release(cq_head_, head + 1);
+			fn(user_data, res);
+		}
+		return count;
+	}
+#else
+public:
+	explicit IoUring(unsigned) {}
+
+	bool valid() const { return false; }
+	unsigned entries() const { return 0; }
+
+	bool prep_rename(uint64_t, int, const char*, int, const char*, unsigned) { return false; }
+	bool prep_statx(uint64_t, int, const char*, unsigned, StatxBuffer*) { return false; }
+	bool submit(unsigned) { return false; }
+
+	template <typename Fn>
+	unsigned withdraw(Fn&&) { return 0; }
+
+	template <typename Fn>
+	unsigned reap(Fn&&) { return 0; }
+#endif
+
+	// Whether a ring with the operations above can be set up here.
+	static bool available() { return IoUring(2).valid(); }
+
+	IoUring(const IoUring&) = delete;
+	IoUring& operator=(const IoUring&) = delete;
+};
+
+} // namespace pt
+
+#endif // !_URING_HPP
@@ -0,0 +1,198 @@
+﻿#ifndef _WORK_POOL_HPP
+#define _WORK_POOL_HPP
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace aop {
+
+// Work-stealing thread pool.
+//
+// Every worker owns a deque: it pushes and pops its own tasks at the back (newest first,
+// which keeps the working set hot), and idle workers steal from the front of the others
+// (oldest first, which are the largest pieces of a recursively split job).
+// Tasks submitted from outside the pool are spread round-robin over the workers.
+class WorkStealingPool {
+public:
+	using Task = std::function<void()>;
+
+private:
+	struct Worker {
+		std::mutex mtx_;
+		std::deque<Task> tasks_;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::vector<std::thread> threads_;
+
+	std::atomic<size_t> pending_{ 0 };	// submitted, not finished
+	std::atomic<size_t> queued_{ 0 };	// sitting in a deque
+	std::atomic<size_t> next_{ 0 };
+
+	std::mutex idle_mtx_;
+	std::condition_variable idle_cv_;
+	std::condition_variable done_cv_;
+	bool stop_ = false;
+
+	std::mutex err_mtx_;
+	std::exception_ptr err_;
+
+	inline static thread_local WorkStealingPool* tls_pool_ = nullptr;
+	inline static thread_local size_t tls_index_ = 0;
+
+	bool try_pop(size_t self, Task& out) {
+		Worker& w = *workers_[self];
+		std::lock_guard<std::mutex> lck(w.mtx_);
+		if (w.tasks_.empty()) return false;
+		out = std::move(w.tasks_.back());
+		w.tasks_.pop_back();
+		return true;
+	}
+
+	bool try_steal(size_t self, Task& out) {
+		const size_t n = workers_.size();
+		for (size_t k = 1; k < n; ++k) {
+			Worker& w = *workers_[(self + k) % n];
+			std::lock_guard<std::mutex> lck(w.mtx_);
+			if (w.tasks_.empty()) continue;
+			out = std::move(w.tasks_.front());
+			w.tasks_.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+	void run_task(Task& task) {
+		try {
+			task();
+		} catch (...) {
+			std::lock_guard<std::mutex> lck(err_mtx_);
+			if (!err_) err_ = std::current_exception();
+		}
+
+		if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			std::lock_guard<std::mutex> lck(idle_mtx_);
+			done_cv_.notify_all();
+		}
+	}
+
+	void worker_loop(size_t self) {
+		tls_pool_ = this;
+		tls_index_ = self;
+
+		while (true) {
+			Task task;
+			if (try_pop(self, task) || try_steal(self, task)) {
+				queued_.fetch_sub(1, std::memory_order_acq_rel);
+				run_task(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lck(idle_mtx_);
+			idle_cv_.wait(lck, [this] { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+			if (stop_ && queued_.load(std::memory_order_acquire) == 0) return;
+		}
+	}
+
+public:
+	// threads == 0 uses one worker per hardware thread.
+	explicit WorkStealingPool(size_t threads = 0) {
+		if (threads == 0) threads = std::thread::hardware_concurrency();
+		if (threads == 0) threads = 1;
+
+		workers_.reserve(threads);
+		for (size_t i = 0; i < threads; ++i) workers_.emplace_back(std::make_unique<Worker>());
+
+		threads_.reserve(threads);
+		for (size_t i = 0; i < threads; ++i) threads_.emplace_back(&WorkStealingPool::worker_loop, this, i);
+	}
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	~WorkStealingPool() {
+		{
+			std::lock_guard<std::mutex> lck(idle_mtx_);
+			stop_ = true;
+		}
+		idle_cv_.notify_all();
+		for (auto& t : threads_) {
+			if (t.joinable()) t.join();
+		}
+	}
+
+	size_t size() const { return workers_.size(); }
+
+	// Index of the calling worker in [0, size()), for per-worker scratch state.
+	// Only meaningful inside a task.
+	static size_t current_worker() { return tls_index_; }
+
+	void submit(Task task) {
+		size_t target = (tls_pool_ == this) ? tls_index_ : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+		pending_.fetch_add(1, std::memory_order_acq_rel);
+		{
+			Worker& w = *workers_[target];
+			std::lock_guard<std::mutex> lck(w.mtx_);
+			w.tasks_.emplace_back(std::move(task));
+		}
+		queued_.fetch_add(1, std::memory_order_acq_rel);
+
+		{
+			std::lock_guard<std::mutex> lck(idle_mtx_);
+		}
+		idle_cv_.notify_one();
+	}
+
+	// Blocks until every submitted task, including tasks submitted by tasks, has finished.
+	// Rethrows the first exception thrown by a task.
+	void wait() {
+		{
+			std::unique_lock<std::mutex> lck(idle_mtx_);
+			done_cv_.wait(lck, [this] { return pending_.load(std::memory_order_acquire) == 0; });
+		}
+
+		std::exception_ptr err;
+		{
+			std::lock_guard<std::mutex> lck(err_mtx_);
+			std::swap(err, err_);
+		}
+		if (err) std::rethrow_exception(err);
+	}
+
+	// Calls fn(b, e) over [begin, end) in pieces of at most grain items and waits for all of them.
+	// The range is split in halves recursively, so thieves pick up large pieces.
+	template <typename Fn>
+	void parallel_for(size_t begin, size_t end, size_t grain, Fn fn) {
+		if (begin >= end) return;
+		if (grain == 0) grain = 1;
+
+		std::function<void(size_t, size_t)> split;
+		split = [this, grain, &fn, &split](size_t b, size_t e) {
+			while (e - b > grain) {
+				size_t mid = b + (e - b) / 2;
+				submit([&split, mid, e] { split(mid, e); });
+				e = mid;
+			}
+			fn(b, e);
+		};
+
+		submit([&split, begin, end] { split(begin, end); });
+		wait();
+	}
+};
+
+}
+
+#endif // !_WORK_POOL_HPP
@@ -0,0 +1,253 @@
+// Headless front end over calc and pt::ProcessThread, for scripted batch jobs and
+// for benchmarking the engine without the GUI.
+//
+// usage: WinFileRenamerCli [options] [FILE...]
+//   -m, --mode expr|auto      expression rename (default) or subtitle auto match
+//   -e, --expr EXPR           the expression, in the syntax of the GUI preview:
+//                             "Video_" + ( INDEX + 1 ) * NUM_FORMAT_3 + ".mp4"
+//   -l, --list FILE           add the files listed in FILE, read through a memory map (repeatable)
+//   -0, --null                the lists are NUL-separated instead of line-separated
+//   -j, --jobs N              rename up to N directory shards at once (default: one per CPU)
+//   -k, --keep-going          keep renaming the other files after a failure
+//   -i, --ignore-case         names differing only in case collide (default on Windows)
+//       --match-case          names differing only in case are different files
+//       --no-atomic           check source and target before each rename instead of using
+//                             the system's atomic no-replace rename
+//   -b, --backend threads|io_uring
+//                             issue renames from a thread pool (default) or queue them to
+//                             io_uring from one thread (Linux)
+//       --queue-depth N       renames in flight at once with io_uring (default: 256)
+//       --stream              evaluate, check and rename block by block, with constant memory;
+//                             dependent renames are only ordered inside a block
+//   -r, --recursive DIR       add the files in DIR and its subdirectories (repeatable)
+//       --max-depth N         enter at most N directory levels below each DIR
+//       --include GLOB        with -r, only add files whose name matches GLOB (repeatable)
+//       --exclude GLOB        with -r, skip files and directories whose name matches GLOB (repeatable)
+//   -q, --quiet               do not print timings
+//   -                         read the file list from stdin
+//
+// Paths and strings are read and written as UTF-8.
+
+#include "process_thread.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+	using pt::Utf8ToWide;
+	using pt::WideToUtf8;
+
+	int usage(const char* msg) {
+		if (msg) std::cerr << "error: " << msg << "\n";
+		std::cerr <<
+			"usage: WinFileRenamerCli [options] [FILE...]\n"
+			"  -m, --mode expr|auto      expression rename (default) or subtitle auto match\n"
+			"  -e, --expr EXPR           the expression, in the syntax of the GUI preview:\n"
+			"                            \"Video_\" + ( INDEX + 1 ) * NUM_FORMAT_3 + \".mp4\"\n"
+			"  -l, --list FILE           add the files listed in FILE, read through a memory map (repeatable)\n"
+			"  -0, --null                the lists are NUL-separated instead of line-separated\n"
+			"  -j, --jobs N              rename up to N directory shards at once (default: one per CPU)\n"
+			"  -k, --keep-going          keep renaming the other files after a failure\n"
+			"  -i, --ignore-case         names differing only in case collide (default on Windows)\n"
+			"      --match-case          names differing only in case are different files\n"
+			"      --no-atomic           check source and target before each rename instead of using\n"
+			"                            the system's atomic no-replace rename\n"
+			"  -b, --backend threads|io_uring\n"
+			"                            issue renames from a thread pool (default) or queue them to\n"
+			"                            io_uring from one thread (Linux)\n"
+			"      --queue-depth N       renames in flight at once with io_uring (default: 256)\n"
+			"      --stream              evaluate, check and rename block by block, with constant memory;\n"
+			"                            dependent renames are only ordered inside a block\n"
+			"  -r, --recursive DIR       add the files in DIR and its subdirectories (repeatable)\n"
+			"      --max-depth N         enter at most N directory levels below each DIR\n"
+			"      --include GLOB        with -r, only add files whose name matches GLOB (repeatable)\n"
+			"      --exclude GLOB        with -r, skip files and directories whose name matches GLOB (repeatable)\n"
+			"  -q, --quiet               do not print timings\n"
+			"  -                         read the file list from stdin\n";
+		return 2;
+	}
+
+	void read_list(std::istream& in, char sep, std::vector<std::wstring>& files) {
+		std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		pt::ForEachListEntry(data, sep, [&](std::string_view item) { files.push_back(Utf8ToWide(item)); });
+	}
+
+	int run(const std::vector<std::string>& args) {
+		auto t_start = std::chrono::steady_clock::now();
+
+		int mode = 0;
+		bool quiet = false;
+		bool from_stdin = false;
+		char sep = '\n';
+		pt::RenameOptions rename_opts;
+		std::wstring expr;
+		std::vector<std::wstring> files;
+		std::vector<std::wstring> lists;
+		std::vector<std::wstring> scan_roots;
+		pt::ScanOptions scan_opts;
+
+		for (size_t i = 0; i < args.size(); ++i) {
+			const std::string& a = args[i];
+			if (a == "-m" || a == "--mode") {
+				if (++i == args.size()) return usage("missing mode");
+				if (args[i] == "expr") mode = 0;
+				else if (args[i] == "auto") mode = 1;
+				else return usage("unknown mode");
+			} else if (a == "-e" || a == "--expr") {
+				if (++i == args.size()) return usage("missing expression");
+				expr = Utf8ToWide(args[i]);
+			} else if (a == "-j" || a == "--jobs") {
+				if (++i == args.size()) return usage("missing job count");
+				char* end = nullptr;
+				unsigned long jobs = std::strtoul(args[i].c_str(), &end, 10);
+				if (args[i].empty() || *end != '\0' || jobs == 0) return usage("invalid job count");
+				rename_opts.concurrency = jobs;
+			} else if (a == "-k" || a == "--keep-going") {
+				rename_opts.stop_on_error = false;
+			} else if (a == "-i" || a == "--ignore-case") {
+				rename_opts.fold_case = true;
+			} else if (a == "--match-case") {
+				rename_opts.fold_case = false;
+			} else if (a == "--no-atomic") {
+				rename_opts.atomic_rename = false;
+			} else if (a == "-b" || a == "--backend") {
+				if (++i == args.size()) return usage("missing backend");
+				if (args[i] == "threads") rename_opts.backend = pt::RenameBackend::THREADS;
+				else if (args[i] == "io_uring") rename_opts.backend = pt::RenameBackend::IO_URING;
+				else return usage("unknown backend");
+			} else if (a == "--queue-depth") {
+				if (++i == args.size()) return usage("missing queue depth");
+				char* end = nullptr;
+				unsigned long depth = std::strtoul(args[i].c_str(), &end, 10);
+				if (args[i].empty() || *end != '\0' || depth == 0) return usage("invalid queue depth");
+				rename_opts.queue_depth = depth;
+			} else if (a == "--stream") {
+				rename_opts.streaming = true;
+			} else if (a == "-l" || a == "--list") {
+				if (++i == args.size()) return usage("missing list file");
+				lists.push_back(Utf8ToWide(args[i]));
+			} else if (a == "-r" || a == "--recursive") {
+				if (++i == args.size()) return usage("missing directory");
+				scan_roots.push_back(Utf8ToWide(args[i]));
+			} else if (a == "--max-depth") {
+				if (++i == args.size()) return usage("missing depth");
+				char* end = nullptr;
+				unsigned long depth = std::strtoul(args[i].c_str(), &end, 10);
+				if (args[i].empty() || *end != '\0') return usage("invalid depth");
+				scan_opts.max_depth = depth;
+			} else if (a == "--include") {
+				if (++i == args.size()) return usage("missing pattern");
+				scan_opts.include.push_back(Utf8ToWide(args[i]));
+			} else if (a == "--exclude") {
+				if (++i == args.size()) return usage("missing pattern");
+				scan_opts.exclude.push_back(Utf8ToWide(args[i]));
+			} else if (a == "-0" || a == "--null") {
+				sep = '\0';
+			} else if (a == "-q" || a == "--quiet") {
+				quiet = true;
+			} else if (a == "-") {
+				from_stdin = true;
+			} else if (a == "-h" || a == "--help") {
+				return usage(nullptr);
+			} else {
+				files.push_back(Utf8ToWide(a));
+			}
+		}
+
+		if (from_stdin) read_list(std::cin, sep, files);
+
+		if (rename_opts.backend == pt::RenameBackend::IO_URING) {
+			if (!rename_opts.atomic_rename) std::cerr << "warning: io_uring needs the atomic rename, renaming with threads\n";
+			else if (!pt::IoUring::available()) std::cerr << "warning: io_uring is not available here, renaming with threads\n";
+		}
+
+		pt::ProcessThread pt;
+		pt.set_rename_options(rename_opts);
+
+		if (mode == 0) {
+			if (expr.empty()) return usage("missing expression");
+			try {
+				pt.set_expr_text(expr);
+			} catch (const std::exception& e) {
+				std::cerr << "error: " << e.what() << "\n";
+				return 2;
+			}
+
+			std::wstring status = pt.get_expression_status();
+			if (!status.empty()) {
+				std::cerr << "error: " << WideToUtf8(status) << "\n";
+				return 2;
+			}
+		}
+
+		size_t duplicates = 0;
+		for (pt::PushStatus status : pt.push_filepaths(std::move(files))) {
+			if (status == pt::PushStatus::DUPLICATE) ++duplicates;
+		}
+
+		for (const auto& list : lists) {
+			size_t added = 0;
+			size_t dup = 0;
+			try {
+				pt.push_filelist(list, sep, added, dup);
+			} catch (const std::exception& e) {
+				std::cerr << "error: " << WideToUtf8(list) << ": " << e.what() << "\n";
+				return 2;
+			}
+			duplicates += dup;
+		}
+
+		scan_opts.fold_case = rename_opts.fold_case;
+		size_t unreadable = 0;
+		for (const auto& root : scan_roots) {
+			pt::ScanStats scanned;
+			size_t dup = 0;
+			pt.push_directory(root, scan_opts, scanned, dup);
+			duplicates += dup;
+			unreadable += scanned.errors;
+		}
+		if (unreadable) std::cerr << "warning: " << unreadable << " directories could not be read\n";
+		if (duplicates) std::cerr << "warning: " << duplicates << " duplicate path(s) ignored\n";
+		double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+
+		pt.process_launch(mode);
+		pt.join();
+
+		pt::JobStats stats = pt.get_last_stats();
+		std::cout << WideToUtf8(pt.get_res_wstr()) << "\n";
+
+		for (const auto& f : pt.get_failed_renames()) {
+			if (f.result.status == pt::RenameStatus::SKIPPED) continue;
+			std::cerr << WideToUtf8(f.src) << " -> " << WideToUtf8(f.dst) << ": " << f.result.error << "\n";
+		}
+
+		if (!quiet) {
+			double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+			std::fprintf(stderr, "files=%zu load=%.3fms prepare=%.3fms rename=%.3fms total=%.3fms\n",
+				stats.files, load_ms, stats.prepare_ms, stats.rename_ms, total_ms);
+		}
+
+		return stats.ok ? 0 : 1;
+	}
+
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t* argv[]) {
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; ++i) args.push_back(WideToUtf8(argv[i]));
+	return run(args);
+}
+#else
+int main(int argc, char* argv[]) {
+	return run(std::vector<std::string>(argv + 1, argv + argc));
+}
+#endif
@@ -0,0 +1,205 @@
+// Checks of the expression compiler and evaluators in calc. Exits non-zero when a check
+// failed.
+
+#include "calc_batch.hpp"
+#include "calc_parser.hpp"
+#include "test_util.hpp"
+
+#include <cstdint>
+#include <exception>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+	const std::vector<std::wstring_view> kNames{ L"a.txt", L"photo.jpg", L"", L"x" };
+	constexpr int64_t kFirstIndex = 7;
+
+	// Names prog gives the rows of kNames, numbered from kFirstIndex.
+	std::vector<std::wstring> run_batch(const calc::Program& prog) {
+		calc::BatchEvaluator eval;
+		eval.run(prog, kFirstIndex, kNames.data(), kNames.size());
+		std::vector<std::wstring> out;
+		for (size_t i = 0; i < eval.size(); ++i) out.emplace_back(eval.result(i));
+		return out;
+	}
+
+	// Names the baseline evaluator gives the rows of kNames for src.
+	std::vector<std::wstring> run_baseline(std::wstring_view src) {
+		calc::IncrementalRpn parsed;
+		calc::parse_expression(src, parsed);
+		std::vector<calc::Element> rpn = calc::generate_rpn(parsed.tokens());
+		std::vector<std::wstring> out;
+		for (size_t i = 0; i < kNames.size(); ++i) {
+			out.push_back(calc::calculate_rpn(calc::preprocess_rpn(rpn, kFirstIndex + static_cast<int64_t>(i), std::wstring(kNames[i]))));
+		}
+		return out;
+	}
+
+	// Empty when fn() returns; otherwise what it threw.
+	template <typename Fn>
+	std::string error_of(Fn&& fn) {
+		try {
+			fn();
+		} catch (const std::exception& e) {
+			return e.what();
+		}
+		return std::string();
+	}
+
+	// The incremental state after every push and pop agrees with compiling the token list
+	// from scratch: same error, or a program giving the same names.
+	void incremental_matches_full_compile() {
+		const std::wstring_view sources[] = {
+			L"\"IMG_\" + ( INDEX + 1 ) * NUM_FORMAT_4 + \"_\" + OFNAME",
+			L"( ( INDEX - 3 ) * 2 + 100 / ( INDEX + 1 ) ) * NUM_FORMAT_3 + \".bin\"",
+			L"\"a\" + ( \"b\" + INDEX ) ) + ( 2 * 3 - 4 * \"c\"",
+		};
+
+		std::mt19937 rng(12345);
+		for (std::wstring_view src : sources) {
+			calc::IncrementalRpn parsed;
+			calc::parse_expression(src, parsed);
+			const std::vector<calc::Element> all = parsed.tokens();
+
+			auto check_state = [](const calc::IncrementalRpn& expr) {
+				calc::Program full;
+				std::string full_err = error_of([&] { full = calc::compile(calc::generate_rpn(expr.tokens())); });
+				CHECK(expr.status() == full_err);
+
+				calc::Program inc;
+				std::string inc_err = error_of([&] { inc = expr.compile(); });
+				CHECK(inc_err == full_err);
+				if (full_err.empty() && inc_err.empty()) CHECK(run_batch(inc) == run_batch(full));
+			};
+
+			// Walk forward through the tokens, now and then backing up a few.
+			calc::IncrementalRpn expr;
+			while (expr.size() < all.size()) {
+				expr.push(all[expr.size()]);
+				check_state(expr);
+				if (rng() % 3 == 0) {
+					size_t back = 1 + rng() % 4;
+					for (size_t k = 0; k < back && !expr.empty(); ++k) {
+						expr.pop();
+						check_state(expr);
+					}
+				}
+			}
+			while (!expr.empty()) {
+				expr.pop();
+				check_state(expr);
+			}
+		}
+	}
+
+	// Subtrees without variables become one constant; the rest keeps its variables.
+	void folds_constants() {
+		calc::Program prog = calc::compile_text(L"\"Show_\" + \"S01\" + \"E\"");
+		CHECK(prog.code().size() == 1 && prog.code()[0].op == calc::OpCode::PUSH_STR);
+		CHECK(prog.pool() == L"Show_S01E");
+		CHECK(run_batch(prog) == std::vector<std::wstring>(kNames.size(), L"Show_S01E"));
+
+		prog = calc::compile_text(L"( 2 + 3 ) * 4 - 30 / 3 + \"x\" + ( 1 + 2 ) * NUM_FORMAT_3");
+		CHECK(prog.code().size() == 1 && prog.pool() == L"10x003");
+
+		prog = calc::compile_text(L"9223372036854775807 + 1 + \"|\" + -9223372036854775808 / -1 + \"|\" + 4294967296 * 4294967296");
+		CHECK(prog.code().size() == 1 && prog.pool() == L"-9223372036854775808|-9223372036854775808|0");
+
+		// Division by zero folds to the same value the evaluators give.
+		prog = calc::compile_text(L"5 / 0");
+		CHECK(prog.code()[0].op == calc::OpCode::PUSH_INT && prog.code()[0].arg == INT64_MAX);
+		CHECK(run_batch(prog) == std::vector<std::wstring>(kNames.size(), L"9223372036854775807"));
+
+		// The constant part of "INDEX + 2 * 3" is folded, OFNAME is not bound.
+		prog = calc::compile_text(L"INDEX + 2 * 3");
+		CHECK(!prog.uses(calc::VarSlot::OFNAME) && prog.var_uses(calc::VarSlot::INDEX) == 1);
+		CHECK(prog.code().size() == 1 && prog.code()[0].op == calc::OpCode::FMT_AFFINE);
+		CHECK(run_batch(prog) == (std::vector<std::wstring>{ L"13", L"14", L"15", L"16" }));
+
+		prog = calc::compile_text(L"OFNAME + \"_\" + OFNAME");
+		CHECK(prog.var_uses(calc::VarSlot::OFNAME) == 2 && !prog.uses(calc::VarSlot::INDEX));
+	}
+
+	// Type errors are found when compiling, before any file is evaluated.
+	void rejects_type_errors() {
+		auto compile_error = [](std::wstring_view src) { return error_of([&] { calc::compile_text(src); }); };
+
+		CHECK(compile_error(L"\"a\" - 1") == "Illegal operator type \"Sub\" !");
+		CHECK(compile_error(L"OFNAME * 2") == "Illegal operator type \"Mul\" !");
+		CHECK(compile_error(L"INDEX / \"b\"") == "Illegal operator type \"Div\" !");
+		CHECK(compile_error(L"NUM_FORMAT_2 + 1") == "Illegal operator type \"Add\" !");
+		CHECK(compile_error(L"NUM_FORMAT_2 * NUM_FORMAT_3") == "Illegal operator type \"Mul\" !");
+		CHECK(compile_error(L"NUM_FORMAT_2") == "Illegal data type in preprocessed RPN !");
+
+		// Inside a subtree that would otherwise fold, or one that uses variables.
+		CHECK(compile_error(L"\"x\" + ( \"a\" - \"b\" )") == "Illegal operator type \"Sub\" !");
+		CHECK(compile_error(L"( INDEX + OFNAME ) * 3") == "Illegal operator type \"Mul\" !");
+	}
+
+	// BatchEvaluator gives every row the name the per-file baseline evaluator gives it.
+	void batch_matches_baseline() {
+		const std::wstring_view sources[] = {
+			L"\"MyVideo_\" + ( INDEX + 1 ) * NUM_FORMAT_3 + \".mp4\"",
+			L"OFNAME + \"_\" + INDEX + \"_\" + OFNAME",
+			L"INDEX * INDEX - 3 * INDEX",
+			L"100 / ( INDEX - 8 ) + \"|\" + ( INDEX - 9 ) * NUM_FORMAT_4",
+			L"( INDEX * -2 + 5 ) * NUM_FORMAT_2 + \"-\" + INDEX / 2 * NUM_FORMAT_0",
+			L"\"a\" + 1 + 2 + \"b\" + ( 1 + 2 ) + OFNAME",
+			L"-5",
+			// Overflow wraps around, and INT64_MIN / -1 gives INT64_MIN.
+			L"INDEX * 4611686018427387904 + 9223372036854775807 - INDEX",
+			L"( INDEX + 9223372036854775800 ) * NUM_FORMAT_2 + \"|\" + ( -9223372036854775808 - INDEX ) * 3",
+			L"-9223372036854775808 / ( 8 - INDEX ) + \"|\" + OFNAME",
+		};
+
+		for (std::wstring_view src : sources) CHECK(run_batch(calc::compile_text(src)) == run_baseline(src));
+	}
+
+	// The parser reads the preview syntax, and reports malformed text with its position.
+	void parses_preview_syntax() {
+		auto names_of = [](std::wstring_view src) { return run_batch(calc::compile_text(src)); };
+		auto compile_error = [](std::wstring_view src) { return error_of([&] { calc::compile_text(src); }); };
+
+		CHECK(names_of(L"\"MyVideo_\" + ( INDEX + 1 ) * NUM_FORMAT_3 + \".mp4\"")[0] == L"MyVideo_008.mp4");
+		CHECK(names_of(L"\"a\\\"b\\\\c\"")[0] == L"a\"b\\c");
+		CHECK(names_of(L"\"\u3042\u3044\" +\tOFNAME")[1] == L"\u3042\u3044photo.jpg");
+
+		// "INDEX-1" subtracts; "INDEX -1" is INDEX followed by the number -1.
+		CHECK(names_of(L"INDEX-1")[0] == L"6");
+		CHECK(names_of(L"( INDEX )-1")[0] == L"6");
+		CHECK(names_of(L"INDEX - -1")[0] == L"8");
+		CHECK(compile_error(L"INDEX -1") == "Missing operator !");
+
+		CHECK(names_of(L"-9223372036854775808")[0] == L"-9223372036854775808");
+		CHECK(compile_error(L"9223372036854775808") == "Number out of range at position 0 !");
+		CHECK(compile_error(L"1 + 12ab") == "Illegal number at position 4 !");
+
+		CHECK(compile_error(L"") == "Empty expression !");
+		CHECK(compile_error(L"  \t ") == "Empty expression !");
+		CHECK(compile_error(L"\"abc") == "Unterminated string at position 0 !");
+		CHECK(compile_error(L"\"a\\n\"") == "Illegal escape at position 2 !");
+		CHECK(compile_error(L"INDEX % 2") == "Unexpected character at position 6 !");
+		CHECK(compile_error(L"INDEX + NAME") == "Unknown identifier at position 8 !");
+		CHECK(compile_error(L"NUM_FORMAT_x") == "Unknown identifier at position 0 !");
+		CHECK(compile_error(L"NUM_FORMAT_101") == "Number format out of range at position 0 !");
+
+		// Well-formedness errors are the ones generate_rpn() gives.
+		CHECK(compile_error(L"( INDEX + 1") == "Match bracket failed !");
+		CHECK(compile_error(L"INDEX + 1 )") == "Match bracket failed !");
+		CHECK(compile_error(L"INDEX +") == "Exceeding operator !");
+		CHECK(compile_error(L"INDEX OFNAME") == "Missing operator !");
+	}
+
+} // namespace
+
+int main() {
+	folds_constants();
+	rejects_type_errors();
+	batch_matches_baseline();
+	parses_preview_syntax();
+	incremental_matches_full_compile();
+	return test::report();
+}
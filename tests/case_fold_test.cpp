@@ -0,0 +1,67 @@
+// Checks of renames that change case only, with fold_case set on a file system where case
+// matters (as on Linux). Exits non-zero when a check failed.
+
+#include "process_thread.hpp"
+#include "test_util.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+	namespace fs = std::filesystem;
+
+	using test::read_file;
+	using test::write_file;
+
+	bool rename_to(pt::RenameBackend backend, const std::wstring& file, const std::wstring& expr) {
+		pt::RenameOptions opts;
+		opts.fold_case = true;
+		opts.backend = backend;
+
+		pt::ProcessThread pt;
+		pt.set_rename_options(opts);
+		pt.set_expr_text(expr);
+		CHECK(pt.push_filepath(file) == pt::PushStatus::ADDED);
+		CHECK(pt.process_launch(0));
+		pt.join();
+		return pt.get_last_stats().ok;
+	}
+
+	// "a" to "A" where "A" is another file must not replace it.
+	void other_file_is_kept(const fs::path& root, pt::RenameBackend backend) {
+		write_file(root / "a", "lower");
+		write_file(root / "A", "upper");
+
+		CHECK(!rename_to(backend, L"a", L"\"A\""));
+		CHECK(read_file(root / "a") == "lower");
+		CHECK(read_file(root / "A") == "upper");
+
+		fs::remove(root / "a");
+		fs::remove(root / "A");
+	}
+
+	// With no such file, the change of case goes through.
+	void free_name_is_renamed(const fs::path& root, pt::RenameBackend backend) {
+		write_file(root / "b", "lower");
+
+		CHECK(rename_to(backend, L"b", L"\"B\""));
+		CHECK(!fs::exists(root / "b"));
+		CHECK(read_file(root / "B") == "lower");
+
+		fs::remove(root / "B");
+	}
+
+}
+
+int main() {
+	test::ScratchDir scratch("wfr_case_fold_test");
+	const fs::path& root = scratch.path();
+
+	for (pt::RenameBackend backend : { pt::RenameBackend::THREADS, pt::RenameBackend::IO_URING }) {
+		other_file_is_kept(root, backend);
+		free_name_is_renamed(root, backend);
+	}
+
+	return test::report();
+}
@@ -0,0 +1,101 @@
+// Checks of the file list sources of pt::ProcessThread, run through a real rename in a
+// scratch directory. Exits non-zero when a check failed.
+
+#include "process_thread.hpp"
+#include "test_util.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+	namespace fs = std::filesystem;
+
+	using test::read_file;
+	using test::write_file;
+
+	// A bare name from a list file is in the current directory, even after paths in other
+	// directories were added through push_filepaths.
+	void bare_name_after_push_filepaths(const fs::path& root) {
+		fs::create_directory(root / "a");
+		write_file(root / "a" / "x.txt", "x");
+		write_file(root / "y.txt", "y");
+		write_file(root / "list", "y.txt\n");
+
+		pt::ProcessThread pt;
+		pt.set_expr_text(L"\"R_\" + INDEX");
+
+		std::vector<std::wstring> files{ L"a/x.txt" };
+		std::vector<pt::PushStatus> status = pt.push_filepaths(std::move(files));
+		CHECK(status.size() == 1 && status[0] == pt::PushStatus::ADDED);
+
+		size_t added = 0;
+		size_t duplicates = 0;
+		CHECK(pt.push_filelist(L"list", '\n', added, duplicates));
+		CHECK(added == 1 && duplicates == 0);
+
+		CHECK(pt.process_launch(0));
+		pt.join();
+
+		CHECK(pt.get_last_stats().ok);
+		CHECK(read_file(root / "a" / "R_0") == "x");
+		CHECK(read_file(root / "R_1") == "y");
+		CHECK(!fs::exists(root / "a" / "R_1"));
+	}
+
+	// The same path from both sources is one file.
+	void duplicates_across_sources(const fs::path& root) {
+		write_file(root / "d.txt", "d");
+		write_file(root / "list2", "d.txt\nd.txt\r\n");
+
+		pt::ProcessThread pt;
+		std::vector<std::wstring> files{ L"d.txt" };
+		CHECK(pt.push_filepaths(std::move(files))[0] == pt::PushStatus::ADDED);
+
+		size_t added = 0;
+		size_t duplicates = 0;
+		CHECK(pt.push_filelist(L"list2", '\n', added, duplicates));
+		CHECK(added == 0 && duplicates == 2);
+		CHECK(pt.push_filepath(L"d.txt") == pt::PushStatus::DUPLICATE);
+	}
+
+	// A scanned tree is added sorted by directory and then by name, whatever order the
+	// workers read it in, after the files that were already selected.
+	void directory_in_stable_order(const fs::path& root) {
+		for (const char* d : { "t/b", "t/a/z", "t/a", "t/c" }) fs::create_directories(root / d);
+		for (const char* f : { "t/b/2", "t/b/1", "t/a/z/9", "t/a/3", "t/c/4", "t/0" }) write_file(root / f, f);
+
+		pt::ProcessThread pt;
+		CHECK(pt.push_filepath(L"t/c/4") == pt::PushStatus::ADDED);
+
+		pt::ScanOptions opts;
+		opts.concurrency = 4;
+		pt::ScanStats stats;
+		size_t duplicates = 0;
+		CHECK(pt.push_directory(L"t", opts, stats, duplicates));
+		CHECK(stats.files == 6 && duplicates == 1);
+
+		std::vector<std::wstring> paths;
+		pt.for_each_file(0, [&](const std::wstring& path) { paths.push_back(path); });
+		const std::vector<std::wstring> expected{ L"t/c/4", L"t/0", L"t/a/3", L"t/a/z/9", L"t/b/1", L"t/b/2" };
+		CHECK(paths == expected);
+
+		CHECK(pt.truncate_files(1));
+		paths.clear();
+		pt.for_each_file(0, [&](const std::wstring& path) { paths.push_back(path); });
+		CHECK(paths.size() == 1 && paths[0] == L"t/c/4");
+		CHECK(pt.push_filepath(L"t/0") == pt::PushStatus::ADDED);
+	}
+
+}
+
+int main() {
+	test::ScratchDir scratch("wfr_file_list_test");
+	const fs::path& root = scratch.path();
+
+	bare_name_after_push_filepaths(root);
+	duplicates_across_sources(root);
+	directory_in_stable_order(root);
+
+	return test::report();
+}
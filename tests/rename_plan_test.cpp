@@ -0,0 +1,168 @@
+// Checks of pt::RenamePlan: where targets lead, and real renames through the expression job
+// in a scratch directory. Exits non-zero when a check failed.
+
+#include "process_thread.hpp"
+#include "test_util.hpp"
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+	namespace fs = std::filesystem;
+
+	using test::read_file;
+	using test::write_file;
+
+	// A string literal of the expression syntax.
+	std::wstring quoted(const std::wstring& text) {
+		std::wstring out(L"\"");
+		for (wchar_t c : text) {
+			if (c == L'"' || c == L'\\') out.push_back(L'\\');
+			out.push_back(c);
+		}
+		return out + L"\"";
+	}
+
+	bool run_job(const std::vector<std::wstring>& files, const std::wstring& expr) {
+		pt::ProcessThread pt;
+		pt.set_expr_text(expr);
+		std::vector<std::wstring> paths(files);
+		for (pt::PushStatus status : pt.push_filepaths(std::move(paths))) CHECK(status == pt::PushStatus::ADDED);
+		CHECK(pt.process_launch(0));
+		pt.join();
+		return pt.get_last_stats().ok;
+	}
+
+	pt::RenamePlan plan_of(const std::vector<std::wstring>& files, std::vector<std::wstring> names) {
+		pt::FileTable table;
+		for (const std::wstring& f : files) table.push(f);
+		return pt::RenamePlan(table, 0, std::move(names), false);
+	}
+
+	// Steps of every shard, as "op:phase" with phase W, T (to temp) or F (from temp).
+	std::vector<std::wstring> steps_of(const pt::RenamePlan& plan) {
+		std::vector<std::wstring> out;
+		for (size_t k = 0; k < plan.shard_count(); ++k) {
+			for (const pt::RenamePlan::Step& st : plan.shard(k)) {
+				const wchar_t* phase = (st.phase == pt::RenamePlan::Phase::WHOLE) ? L"W" : (st.phase == pt::RenamePlan::Phase::TO_TEMP) ? L"T" : L"F";
+				out.push_back(std::to_wstring(st.op) + L":" + phase);
+			}
+		}
+		return out;
+	}
+
+	// Runs the steps over a set of existing paths: every step must find its source and
+	// must not overwrite anything. Returns the paths left at the end.
+	std::set<std::wstring> simulate(const pt::RenamePlan& plan, std::set<std::wstring> paths) {
+		for (size_t k = 0; k < plan.shard_count(); ++k) {
+			for (const pt::RenamePlan::Step& st : plan.shard(k)) {
+				std::wstring src = plan.step_src(st), dst = plan.step_dst(st);
+				CHECK(paths.erase(src) == 1);
+				CHECK(paths.insert(dst).second);
+			}
+		}
+		return paths;
+	}
+
+	// A rooted new name is the whole target path; a relative one, even with "..", is joined
+	// to the directory of its file.
+	void targets_of_names(const fs::path& root) {
+		const std::wstring abs = (root / "abs").generic_wstring() + L"/y";
+
+		pt::FileTable files;
+		files.push(L"d/x");
+		files.push(L"d/y");
+		pt::RenamePlan plan(files, 0, { abs, L"../z" }, false);
+		CHECK(plan.dst(0) == pt::MakeLongPath(abs));
+		CHECK(plan.dst(1) == L"d/../z");
+		CHECK(plan.src(0) == L"d/x" && plan.src(1) == L"d/y");
+	}
+
+	void rename_to_absolute_path(const fs::path& root) {
+		fs::create_directories(root / "d1");
+		fs::create_directories(root / "abs");
+		write_file(root / "d1" / "y", "y");
+
+		CHECK(run_job({ L"d1/y" }, quoted((root / "abs").generic_wstring() + L"/") + L" + OFNAME"));
+		CHECK(read_file(root / "abs" / "y") == "y");
+		CHECK(!fs::exists(root / "d1" / "y"));
+	}
+
+	void rename_to_parent_directory(const fs::path& root) {
+		fs::create_directories(root / "d2");
+		write_file(root / "d2" / "p", "p");
+
+		CHECK(run_job({ L"d2/p" }, quoted(L"../") + L" + OFNAME"));
+		CHECK(read_file(root / "p") == "p");
+		CHECK(!fs::exists(root / "d2" / "p"));
+	}
+
+	// 1 -> 2 -> 3 -> 4 runs back to front without temporary names.
+	void orders_chain() {
+		pt::RenamePlan plan = plan_of({ L"d/1", L"d/2", L"d/3" }, { L"2", L"3", L"4" });
+		CHECK(steps_of(plan) == (std::vector<std::wstring>{ L"2:W", L"1:W", L"0:W" }));
+		CHECK(!plan.temp(0) && !plan.temp(1) && !plan.temp(2));
+		CHECK(simulate(plan, { L"d/1", L"d/2", L"d/3" }) == (std::set<std::wstring>{ L"d/2", L"d/3", L"d/4" }));
+	}
+
+	// a <-> b needs one temporary name, next to the file it holds.
+	void orders_swap() {
+		pt::RenamePlan plan = plan_of({ L"d/a", L"d/b" }, { L"b", L"a" });
+		CHECK(steps_of(plan) == (std::vector<std::wstring>{ L"0:T", L"1:W", L"0:F" }));
+		CHECK(plan.temp(0) && *plan.temp(0) == L"d/~wfr0.tmp" && !plan.temp(1));
+		CHECK(simulate(plan, { L"d/a", L"d/b" }) == (std::set<std::wstring>{ L"d/a", L"d/b" }));
+	}
+
+	// A cycle of n renames takes n + 1 steps and one temporary name; a second cycle gets
+	// a temporary name of its own, and a chain next to them (5 -> 6) none.
+	void orders_cycles() {
+		pt::RenamePlan plan = plan_of({ L"d/1", L"d/2", L"d/3", L"d/4", L"d/5", L"d/x", L"d/y" }, { L"2", L"3", L"4", L"1", L"6", L"y", L"x" });
+		CHECK(steps_of(plan) == (std::vector<std::wstring>{ L"0:T", L"3:W", L"2:W", L"1:W", L"0:F", L"4:W", L"5:T", L"6:W", L"5:F" }));
+		CHECK(plan.temp(0) && *plan.temp(0) == L"d/~wfr0.tmp");
+		CHECK(plan.temp(5) && *plan.temp(5) == L"d/~wfr5.tmp");
+		CHECK(!plan.temp(1) && !plan.temp(2) && !plan.temp(3) && !plan.temp(4) && !plan.temp(6));
+		CHECK(simulate(plan, { L"d/1", L"d/2", L"d/3", L"d/4", L"d/5", L"d/x", L"d/y" }) == (std::set<std::wstring>{ L"d/1", L"d/2", L"d/3", L"d/4", L"d/6", L"d/x", L"d/y" }));
+	}
+
+	// The temporary name avoids every path of the plan.
+	void temp_avoids_plan_paths() {
+		pt::RenamePlan plan = plan_of({ L"d/a", L"d/b", L"d/~wfr0.tmp" }, { L"b", L"a", L"~wfr0_1.tmp" });
+		CHECK(plan.temp(0) && *plan.temp(0) == L"d/~wfr0_2.tmp");
+		CHECK(simulate(plan, { L"d/a", L"d/b", L"d/~wfr0.tmp" }) == (std::set<std::wstring>{ L"d/a", L"d/b", L"d/~wfr0_1.tmp" }));
+	}
+
+	// Shifting a numbered series by one, and swapping two files, on disk.
+	void rename_chain_and_swap(const fs::path& root) {
+		fs::create_directories(root / "s");
+		for (int i = 0; i < 5; ++i) write_file(root / "s" / std::to_string(i), std::to_string(i));
+		CHECK(run_job({ L"s/0", L"s/1", L"s/2", L"s/3", L"s/4" }, L"INDEX + 1"));
+		for (int i = 0; i < 5; ++i) CHECK(read_file(root / "s" / std::to_string(i + 1)) == std::to_string(i));
+		CHECK(!fs::exists(root / "s" / "0"));
+
+		fs::create_directories(root / "w");
+		write_file(root / "w" / "0", "a");
+		write_file(root / "w" / "1", "b");
+		CHECK(run_job({ L"w/0", L"w/1" }, L"1 - INDEX"));
+		CHECK(read_file(root / "w" / "0") == "b" && read_file(root / "w" / "1") == "a");
+		CHECK(std::distance(fs::directory_iterator(root / "w"), fs::directory_iterator()) == 2);
+	}
+
+}
+
+int main() {
+	test::ScratchDir scratch("wfr_rename_plan_test");
+	const fs::path& root = scratch.path();
+
+	targets_of_names(root);
+	rename_to_absolute_path(root);
+	rename_to_parent_directory(root);
+	orders_chain();
+	orders_swap();
+	orders_cycles();
+	temp_avoids_plan_paths();
+	rename_chain_and_swap(root);
+
+	return test::report();
+}
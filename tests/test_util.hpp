@@ -0,0 +1,82 @@
+#ifndef _TEST_UTIL_HPP
+#define _TEST_UTIL_HPP
+
+#pragma once
+
+// Helpers shared by the tests: a CHECK that counts failures instead of stopping, small
+// file helpers, and a scratch directory each test program runs in.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+namespace test {
+
+	namespace fs = std::filesystem;
+
+	inline int failures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++test::failures; \
+		} \
+	} while (0)
+
+	inline void write_file(const fs::path& p, const std::string& text) {
+		std::ofstream out(p, std::ios::binary);
+		out << text;
+	}
+
+	inline std::string read_file(const fs::path& p) {
+		std::ifstream in(p, std::ios::binary);
+		return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	}
+
+	// A new directory under the system temp directory, current while the object lives and
+	// removed with it. The name is unique per run, so test programs running at the same
+	// time never share or remove each other's directory.
+	class ScratchDir {
+	private:
+		fs::path root_;
+		fs::path old_cwd_;
+
+	public:
+		explicit ScratchDir(const std::string& prefix) {
+			std::random_device rd;
+			std::mt19937_64 gen((static_cast<uint64_t>(rd()) << 32) ^ rd() ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+			do {
+				root_ = fs::temp_directory_path() / (prefix + "_" + std::to_string(gen()));
+			} while (!fs::create_directories(root_));
+
+			old_cwd_ = fs::current_path();
+			fs::current_path(root_);
+		}
+
+		~ScratchDir() {
+			std::error_code ec;
+			fs::current_path(old_cwd_, ec);
+			fs::remove_all(root_, ec);
+		}
+
+		ScratchDir(const ScratchDir&) = delete;
+		ScratchDir& operator=(const ScratchDir&) = delete;
+
+		const fs::path& path() const { return root_; }
+	};
+
+	// The exit code of a test program.
+	inline int report() {
+		if (failures) std::fprintf(stderr, "%d check(s) failed\n", failures);
+		return failures ? 1 : 0;
+	}
+
+}
+
+#endif // !_TEST_UTIL_HPP